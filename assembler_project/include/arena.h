@@ -0,0 +1,54 @@
+/* arena.h */
+/**
+ * @file arena.h
+ * @brief Declares a bump allocator for the nodes created while assembling one file.
+ *
+ * Instructions, symbols and symbol names all live
+ * exactly as long as the file they belong to, so they are carved out of large
+ * chunks and released together with a single freeArena call.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "assembler.h" /* Includes the Arena and ArenaChunk structs */
+
+/**
+ * @brief Initializes an empty arena. No memory is reserved until the first allocation.
+ * @param arena Pointer to the Arena to initialize.
+ */
+void initArena(Arena *arena);
+
+/**
+ * @brief Allocates 'size' bytes from the arena, aligned for any object type.
+ * The memory is not cleared. Terminates the program if memory runs out.
+ * @param arena Pointer to the arena.
+ * @param size Number of bytes requested.
+ * @return Pointer to the allocated block, valid until freeArena.
+ */
+void* arenaAlloc(Arena *arena, size_t size);
+
+/**
+ * @brief Copies a null-terminated string into the arena.
+ * @param arena Pointer to the arena.
+ * @param str The string to copy.
+ * @return Pointer to the copy, valid until freeArena.
+ */
+const char* arenaStrdup(Arena *arena, const char *str);
+
+/**
+ * @brief Moves every chunk of one arena into another, so they are released by
+ * the destination's freeArena. Blocks already allocated stay where they are.
+ * @param dest Arena that takes over the chunks.
+ * @param src Arena to empty; it may be reused immediately.
+ */
+void moveArena(Arena *dest, Arena *src);
+
+/**
+ * @brief Releases every chunk of the arena at once.
+ * The arena is left empty and may be reused immediately.
+ * @param arena Pointer to the arena.
+ */
+void freeArena(Arena *arena);
+
+#endif
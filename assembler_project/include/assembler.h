@@ -6,8 +6,8 @@
  *
  * It includes definitions for memory organization, symbol table entries,
  * instruction and data representations, and macro definitions.
- * It also declares the global error flag and prototypes for common helper functions
- * used across multiple modules.
+ * It also defines the per-file assembly context and prototypes for common helper
+ * functions used across multiple modules.
  */
 
 #ifndef ASSEMBLER_H
@@ -17,6 +17,7 @@
 #include <stdlib.h>
 #include <string.h> /* Required for string manipulation functions */
 #include <ctype.h>  /* Required for isspace, isalpha, isdigit, etc. */
+#include <stdint.h> /* Required for uint16_t machine words */
 
 /* --- Constants for Assembler Configuration --- */
 #define MEMORY_START 100            /**< Starting memory address for instructions. */
@@ -25,8 +26,24 @@
 #define MAX_OPCODE_LENGTH 5         /**< Max opcode string length (e.g., "stop" + '\0'). */
 #define MAX_REGISTER_NAME_LENGTH 3  /**< Max register name length (e.g., "r7" + '\0'). */
 #define BASE4_WORD_LENGTH 5         /**< Length of a machine word in base-4 representation (10 bits = 5 base-4 digits). */
+#define MAX_INSTRUCTION_WORDS 5     /**< Longest instruction: opcode word plus two matrix operands. */
 
-#define INITIAL_MACRO_LINES_CAPACITY 10 /**< Initial capacity for dynamic array storing macro lines. */
+#define INITIAL_SYMBOL_TABLE_CAPACITY 64 /**< Initial slot count of the symbol hash index (power of two). */
+#define INITIAL_MACRO_TABLE_CAPACITY 16  /**< Initial slot count of the macro hash index (power of two). */
+#define ARENA_INITIAL_CHUNK_SIZE 16384  /**< Size of the first chunk of a per-file arena, in bytes. */
+#define ARENA_MAX_CHUNK_SIZE 1048576    /**< Chunk sizes double up to this limit. */
+#define INITIAL_FIXUP_CAPACITY 64       /**< Initial capacity of the one-pass fixup table. */
+#define INITIAL_DATA_SEGMENT_CAPACITY 256 /**< Initial capacity (in words) of a data segment. */
+#define INITIAL_ZERO_RUN_CAPACITY 16    /**< Initial capacity of a data segment's zero runs. */
+#define MIN_ZERO_RUN_LENGTH 16          /**< Shortest .mat zero fill kept as a run instead of stored words. */
+#define INITIAL_PARSED_LINE_CAPACITY 256 /**< Initial capacity of a first pass chunk's line records. */
+#define MIN_FIRST_PASS_CHUNK_SIZE 65536 /**< Smallest slice of source (in bytes) parsed on its own thread. */
+#define MIN_EXPANSION_CHUNK_SIZE 65536  /**< Smallest range of source (in bytes) macro-expanded on its own thread. */
+#define MIN_ENCODE_CHUNK_SIZE 4096      /**< Fewest instructions encoded on their own thread in the second pass. */
+#define MIN_OBJECT_CHUNK_WORDS 16384    /**< Fewest .ob lines formatted on their own thread. */
+#define INITIAL_EXTERNAL_BUFFER_CAPACITY 64 /**< Initial capacity of a second pass worker's external references. */
+#define INITIAL_EXTERNAL_TABLE_CAPACITY 64 /**< Initial capacity of a symbol table's external references. */
+#define INITIAL_ENTRY_INDEX_CAPACITY 16 /**< Initial capacity of a symbol table's entry index. */
 
 /* --- A,R,E Bit Encoding Constants --- */
 /**
@@ -42,6 +59,11 @@
 #define ARE_RELOCATABLE 'c'  /* 10 - Relocatable address */
 /* Note: Data words don't use A,R,E encoding and can use all 10 bits */
 
+/* Numeric values of the same A,R,E fields, as stored in encoded words */
+#define ARE_ABSOLUTE_BITS    0
+#define ARE_EXTERNAL_BITS    1
+#define ARE_RELOCATABLE_BITS 2
+
 /* --- Enum Definitions --- */
 
 /**
@@ -54,85 +76,247 @@ typedef enum {
     SYMBOL_ENTRY      /**< Symbol is declared as an entry point (.entry). */
 } SymbolType;
 
-/* --- Structure Forward Declarations --- */
-/* Used to resolve circular dependencies between Symbol and ExternalUsage.*/
-typedef struct ExternalUsage ExternalUsage;
+/**
+ * @brief Instruction opcodes; the value is the 4-bit opcode field of the first word.
+ */
+typedef enum {
+    OPCODE_MOV, OPCODE_CMP, OPCODE_ADD, OPCODE_SUB,
+    OPCODE_NOT, OPCODE_CLR, OPCODE_LEA, OPCODE_INC,
+    OPCODE_DEC, OPCODE_JMP, OPCODE_BNE, OPCODE_RED,
+    OPCODE_PRN, OPCODE_JSR, OPCODE_RTS, OPCODE_STOP
+} Opcode;
+
+/**
+ * @brief Operand addressing modes; the value is the 2-bit mode field of the first word.
+ */
+typedef enum {
+    ADDR_IMMEDIATE = 0,  /**< #value */
+    ADDR_DIRECT = 1,     /**< LABEL */
+    ADDR_MATRIX = 2,     /**< LABEL[rX][rY] */
+    ADDR_REGISTER = 3    /**< r0 - r7 */
+} AddressingMode;
 
 /* --- Structure Definitions --- */
 
 /**
  * @brief Represents a symbol (label) in the assembler's symbol table.
  * Contains the symbol's name, its memory address, and its type.
- * For external symbols, it also links to a list of places where it's used.
+ * The places where external symbols are used are kept in the table's external references.
  */
 typedef struct Symbol {
-    char name[MAX_SYMBOL_LENGTH];   /**< The name of the symbol. */
+    const char *name;               /**< The name of the symbol (copied into the file's arena). */
+    unsigned long hash;             /**< Cached hash of the name, used for probing and rehashing. */
     int address;                    /**< The memory address of the symbol. */
     SymbolType type;                 /**< The type of the symbol (Code, Data, External, Entry). */
     struct Symbol *next;            /**< Pointer to the next symbol in the linked list. */
-    ExternalUsage *external_usages; /**< Head of a linked list tracking where this external symbol is referenced. */
+    int id;                         /**< Declaration index (0 for the first symbol); the list is in descending id order. */
 } Symbol;
 
 /**
- * @brief Tracks a single instance where an external symbol is referenced in the code.
+ * @brief Records a single instance where an external symbol is referenced in the code.
  * Used to generate the .ext (externals) output file.
  */
-struct ExternalUsage {
-    int address;          /**< The memory address (IC value) where the external symbol is referenced. */
-    ExternalUsage *next;  /**< Pointer to the next external usage in the list. */
-};
+typedef struct ExternalReference {
+    Symbol *sym;                    /**< The external symbol. */
+    int address;                    /**< The memory address (IC value) of the word that refers to it. */
+} ExternalReference;
+
+/**
+ * @brief The symbol table: a linked list in declaration order (newest first),
+ * indexed by an open-addressing hash table for constant-time lookups.
+ * The list is what iteration (output files, address fix-ups) walks, so its
+ * order is exactly the one the plain linked-list table produced.
+ */
+typedef struct SymbolTable {
+    Symbol *head;                  /**< Most recently declared symbol; walk 'next' for the rest. */
+    Symbol **slots;                /**< Hash index (linear probing); NULL marks an empty slot. */
+    int capacity;                  /**< Number of slots, always a power of two. */
+    int count;                     /**< Number of symbols stored. */
+    Symbol **entries;              /**< Entry index: every SYMBOL_ENTRY symbol, in ascending id (declaration) order. */
+    int num_entries;               /**< Number of entry symbols. */
+    int entries_capacity;          /**< Allocated length of 'entries'. */
+    ExternalReference *externals;  /**< Relocation table: every external reference, in the order it was encoded. */
+    int num_externals;             /**< Number of external references. */
+    int externals_capacity;        /**< Allocated length of 'externals'. */
+} SymbolTable;
+
+/**
+ * @brief A parsed instruction operand.
+ * Label operands keep their source text (copied into the file's arena) because
+ * forward references can only be resolved once all labels are known.
+ */
+typedef struct Operand {
+    unsigned char mode;                 /**< AddressingMode of the operand. */
+    union {
+        int immediate;                  /**< ADDR_IMMEDIATE: the value as written (range checked when encoded). */
+        unsigned char reg;              /**< ADDR_REGISTER: register number 0-7. */
+        struct {
+            const char *text;           /**< Full operand text, e.g. "M1[r2][r7]". */
+            unsigned char length;       /**< Length of the label prefix of 'text'. */
+            signed char row_reg;        /**< ADDR_MATRIX: row register, or -1 if not r0-r7. */
+            signed char col_reg;        /**< ADDR_MATRIX: column register, or -1 if not r0-r7. */
+        } label;                        /**< ADDR_DIRECT and ADDR_MATRIX. */
+    } value;
+} Operand;
 
 /**
  * @brief Represents a single machine instruction parsed from the source code.
- * Stores parsed operands and eventually the encoded machine code.
+ * Stores the parsed operands and eventually the encoded machine words;
+ * words are converted to base-4 text only when the object file is written.
  */
 typedef struct Instruction {
-    int address;                                          /**< The instruction's memory address (IC value). */
-    int original_line_number;                             /**< The original line number from the source .as file for error reporting. */
-    char opcode[MAX_OPCODE_LENGTH];                       /**< The opcode string (e.g., "mov", "add"). */
-    int num_operands;                                     /**< Number of operands (0, 1, or 2) parsed for this instruction. */
-    char operand1[MAX_LINE_LENGTH];                       /**< String representation of the first operand. */
-    char operand2[MAX_LINE_LENGTH];                       /**< String representation of the second operand. */
-    int instruction_length;                               /**< The total length of the instruction in machine words (1-5). */
-    char machine_code_base4[BASE4_WORD_LENGTH + 1];       /**< The first word of machine code (opcode word) in base-4. */
-    char operand_words_base4[4][BASE4_WORD_LENGTH + 1];   /**< Up to 4 additional words for operands in base-4. */
-    int num_operand_words;                                /**< The actual number of additional operand words generated. */
-    
-    struct Instruction* next;                             /**< Pointer to the next instruction in the linked list. */
+    int address;                                /**< The instruction's memory address (IC value). */
+    int original_line_number;                   /**< The original line number from the source .as file for error reporting. */
+    unsigned char opcode;                       /**< The Opcode of the instruction. */
+    unsigned char num_operands;                 /**< Number of operands (0, 1, or 2) parsed for this instruction. */
+    unsigned char instruction_length;           /**< The total length of the instruction in machine words (1-5). */
+    unsigned char num_operand_words;            /**< The actual number of additional operand words generated. */
+    Operand operands[2];                        /**< Parsed operands; a single operand is stored first. */
+    uint16_t words[MAX_INSTRUCTION_WORDS];      /**< Encoded 10-bit words; words[0] is the opcode word. */
+
+    struct Instruction* next;                   /**< Pointer to the next instruction in the linked list. */
 } Instruction;
+
+/**
+ * @brief What a fixup does once all symbol addresses are final.
+ */
+typedef enum FixupKind {
+    FIXUP_LABEL,            /**< Patch a label operand word with the symbol's address. */
+    FIXUP_IMMEDIATE_RANGE,  /**< Report an immediate operand out of the 10-bit range. */
+    FIXUP_MATRIX_REGISTERS, /**< Report invalid index registers of a matrix operand. */
+    FIXUP_LENGTH_MISMATCH   /**< Report an instruction whose words don't match its first pass length. */
+} FixupKind;
+
+/**
+ * @brief A label operand word whose address is patched after the first pass, or an
+ * encoding error reported at that point (one-pass mode). Errors wait for the labels
+ * before them in the instruction, since the second pass stops at an undefined one.
+ */
+typedef struct Fixup {
+    Instruction *inst;      /**< Instruction that owns the word. */
+    int word_index;         /**< Index into inst->words (FIXUP_LABEL only). */
+    int operand_index;      /**< Index into inst->operands of the label (or faulty) operand. */
+    FixupKind kind;         /**< Label word or deferred error. */
+} Fixup;
+
 /**
- * @brief Represents a data item parsed from .data, .string, or .mat directives.
- * Stores the raw value and its base-4 representation.
+ * @brief Growable table of pending fixups, recorded in ascending address order.
  */
-typedef struct DataItem {
-    int address;                           /**< The data item's memory address (DC value). */
-    int value;                             /**< The raw integer value of the data item. */
-    char base4_representation[BASE4_WORD_LENGTH + 1]; /**< The base-4 string representation of the value. */
-    struct DataItem* next;                 /**< Pointer to the next data item in the linked list. */
-} DataItem;
+typedef struct FixupTable {
+    Fixup *items;           /**< Dynamic array of fixups. */
+    int count;              /**< Number of fixups recorded. */
+    int capacity;           /**< Allocated capacity of 'items'. */
+} FixupTable;
+
+/**
+ * @brief A run of zero data words (such as the uninitialized cells of a .mat)
+ * that takes no space in the data segment's word array.
+ */
+typedef struct ZeroRun {
+    int offset;                            /**< DC value of the first zero word. */
+    int count;                             /**< Number of zero words. */
+} ZeroRun;
+
+/**
+ * @brief The data segment: the words of .data, .string and .mat directives in
+ * DC order. Explicit words are stored contiguously; long runs of zeros are kept
+ * as ZeroRuns and only expanded when the object file is written.
+ * Values are converted to base-4 only when the object file is written.
+ */
+typedef struct DataSegment {
+    int16_t *words;                        /**< Explicit words, in DC order, skipping the zero runs. */
+    int stored;                            /**< Number of explicit words. */
+    int capacity;                          /**< Allocated length of 'words'. */
+    ZeroRun *runs;                         /**< Zero runs in ascending offset order. */
+    int num_runs;                          /**< Number of zero runs. */
+    int runs_capacity;                     /**< Allocated length of 'runs'. */
+    int count;                             /**< Number of data words, zero runs included (the DC). */
+} DataSegment;
 
 /**
  * @brief Represents a macro definition.
- * Stores the macro's name and its content lines.
+ * Stores the macro's name and the location of its content lines, joined into one
+ * block of text inside the MacroTable's string pool, so a call site is expanded
+ * by copying a single span.
  */
 typedef struct Macro {
     char name[MAX_SYMBOL_LENGTH];          /**< The name of the macro. */
-    char **lines;                          /**< Dynamic array of strings (lines) that make up the macro's content. */
-    int lineCount;                         /**< The number of lines currently stored in the macro. */
-    int capacity;                          /**< The current allocated capacity for the 'lines' array. */
+    size_t body_offset;                    /**< Start of the body in MacroTable::pool. */
+    size_t body_length;                    /**< Number of characters in the body (lines separated by '\n', no trailing newline). */
+    int lineCount;                         /**< The number of lines stored in the macro. */
+    unsigned long hash;                    /**< Cached hash of the name, used for probing and rehashing. */
     struct Macro *next;                    /**< Pointer to the next macro definition in the linked list. */
 } Macro;
 
+/**
+ * @brief All macros of a source file: a definition-order list, indexed by an
+ * open-addressing hash table so that each expanded line costs a single probe
+ * sequence. The Macro structures come from the file's arena and every body is
+ * stored back to back in one string pool, so the table itself owns only two blocks.
+ */
+typedef struct MacroTable {
+    Macro *head;                   /**< Most recently defined macro; walk 'next' for the rest. */
+    Macro **slots;                 /**< Hash index (linear probing); NULL marks an empty slot. */
+    int capacity;                  /**< Number of slots, always a power of two. */
+    int count;                     /**< Number of macros stored. */
+    char *pool;                    /**< Bodies of all macros (addressed by offset, since the pool may move when it grows). */
+    size_t pool_length;            /**< Number of characters used in 'pool'. */
+    size_t pool_capacity;          /**< Allocated size of 'pool'. */
+} MacroTable;
+
 
 
 
-/* --- Global Variables --- */
+/* --- Per-File Assembly Context --- */
+
+/**
+ * @brief One block of an arena; its data immediately follows the header.
+ */
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;   /**< Previously filled chunk. */
+    size_t size;               /**< Usable bytes in this chunk. */
+    size_t used;               /**< Bytes already handed out. */
+} ArenaChunk;
+
+/**
+ * @brief Bump allocator owning every node created for one file (see arena.h).
+ */
+typedef struct Arena {
+    ArenaChunk *chunks;        /**< Newest chunk first; allocations come from its tail. */
+    size_t next_size;          /**< Data size of the next chunk to be added. */
+} Arena;
+
+/**
+ * @brief Order of the lines of the .ext file.
+ */
+typedef enum ExternalsOrder {
+    EXT_ORDER_SYMBOL,   /**< Grouped by symbol, newest declaration first; each symbol's usages newest first. */
+    EXT_ORDER_ADDRESS   /**< Ascending address of the referring word. */
+} ExternalsOrder;
+
+/**
+ * @brief Options selected on the command line; shared read-only by all files.
+ */
+typedef struct AssemblerOptions {
+    int one_pass;   /**< Encode during the first pass and patch labels from a fixup table. */
+    int jobs;       /**< Number of files assembled concurrently (1 = sequential). */
+    int threads;    /**< Number of threads that share the work on a single file (1 = sequential). */
+    int write_am;   /**< Also save the macro-expanded source as a .am file (for inspection only). */
+    ExternalsOrder ext_order; /**< Order of the lines of the .ext file. */
+} AssemblerOptions;
 
 /**
- * @brief Global error flag. Set to 1 if any assembly error occurs,
- * preventing the generation of output files.
+ * @brief State owned by the assembly of a single source file.
+ * Every module receives the context explicitly instead of sharing globals, so
+ * independent files can be assembled concurrently on different threads.
  */
-extern int g_has_error; /* Defined in main.c */
+typedef struct AssemblerContext {
+    const AssemblerOptions *options; /**< Command line options. */
+    int has_error;                   /**< Set to 1 if any assembly error occurs, preventing output files. */
+    FILE *out;                       /**< Destination of progress messages (stdout or a per-file buffer). */
+    FILE *err;                       /**< Destination of diagnostics (stderr or a per-file buffer). */
+    Arena arena;                     /**< Instructions and symbols of the file. */
+} AssemblerContext;
 
 /* --- Common Helper Function Prototypes (implemented in first_pass.c or utilities.c) --- */
 
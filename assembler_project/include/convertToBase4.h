@@ -2,17 +2,18 @@
 #define CONVERTTOBASE4_H
 
 /**
- * @brief Converts a 10-bit value to a base-4 representation.
- * @param value The integer value to convert.
- * @return A dynamically allocated string with the base-4 representation (always 5 characters).
+ * @brief Converts a 10-bit value to a base-4 representation in a caller-provided buffer.
+ * Uses a precomputed table of all 1024 words; nothing is allocated.
+ * @param value The integer value to convert (masked to 10 bits).
+ * @param out Buffer of at least 6 characters; receives 5 base-4 digits and a terminator.
  */
-char* convertToBase4(int value);
+void convertToBase4Buffer(int value, char *out);
 
 /**
- * @brief Strips leading 'a' characters from a base-4 string.
- * @param base4_str The base-4 string to strip
- * @return A dynamically allocated string without leading 'a's.
+ * @brief Skips leading 'a' characters of a base-4 string (keeping at least one).
+ * @param base4_str The base-4 string.
+ * @return Pointer into 'base4_str'; nothing is allocated.
  */
-char* stripLeadingA(const char* base4_str);
+const char* skipLeadingA(const char* base4_str);
 
-#endif /* CONVERTTOBASE4_H */
\ No newline at end of file
+#endif /* CONVERTTOBASE4_H */
@@ -10,7 +10,9 @@
 #ifndef FIRST_PASS_H
 #define FIRST_PASS_H
 
-#include "assembler.h" /* Includes common definitions like Symbol, Instruction, DataItem */
+#include "assembler.h" /* Includes common definitions like Symbol, Instruction, DataSegment */
+#include "opcodes.h"   /* For OpcodeInfo */
+#include "line_reader.h" /* For LineReader */
 #include "convertToBase4.h" /* CRITICAL: Must be included for convertToBase4 function declaration */
 
 /* --- Function Prototypes --- */
@@ -18,16 +20,31 @@
 /**
  * @brief Performs the first pass of the assembler.
  * Reads the assembly source file line by line, builds the symbol table,
- * and populates the instruction and data lists.
- * @param input The file pointer to the assembly source.
- * @param symTab Pointer to the head of the Symbol linked list.
+ * and populates the instruction list and the data segment.
+ * @param ctx The assembly context (error flag and diagnostics stream).
+ * @param input Reader over the expanded (.am) source.
+ * @param symTab Pointer to the symbol table.
  * @param instructionList Pointer to the head of the Instruction linked list.
- * @param dataList Pointer to the head of the DataItem linked list.
+ * @param data Empty data segment that receives the data words.
  * @param final_ic_out Pointer to store the final Instruction Counter value.
  * @param final_dc_out Pointer to store the final Data Counter value.
+ * @param fixups If non-NULL, each instruction is encoded as soon as it is parsed (one-pass mode)
+ *               and its label operands are recorded here for resolveFixups; NULL for the two-pass flow.
  * @return 1 if the first pass completed successfully without critical errors, 0 otherwise.
  */
-int firstPass(FILE *input, Symbol **symTab, Instruction **instructionList, DataItem **dataList, int *final_ic_out, int *final_dc_out);
+int firstPass(AssemblerContext *ctx, LineReader *input, SymbolTable *symTab, Instruction **instructionList, DataSegment *data, int *final_ic_out, int *final_dc_out, FixupTable *fixups);
+
+/**
+ * @brief Initializes an empty data segment.
+ * @param data Pointer to the DataSegment to initialize.
+ */
+void initDataSegment(DataSegment *data);
+
+/**
+ * @brief Frees the words of a data segment and leaves it empty.
+ * @param data Pointer to the DataSegment.
+ */
+void freeDataSegment(DataSegment *data);
 
 /* --- Helper Function Prototypes (implemented in first_pass.c) --- */
 
@@ -48,24 +65,24 @@ extern int is_valid_number(const char *s);
 /**
  * @brief Calculates the length of a machine instruction in memory words.
  * Handles cases including immediate, direct, matrix and register operands.
- * @param opcode The instruction opcode string.
- * @param operand1 The string of the first operand.
- * @param operand2 The string of the second operand (empty string if not present).
- * @return Instruction length in memory words (1-5), or -1 on error (e.g., invalid operand count for opcode).
+ * @param opcode Descriptor of the instruction's opcode.
+ * @param operands The parsed operands (a single operand is stored first).
+ * @param num_operands The number of operands found in the line (0, 1, or 2).
+ * @return Instruction length in memory words (1-5), or -1 on error (invalid operand count for opcode).
  */
-extern int calculate_instruction_length(const char* opcode, const char* operand1, const char* operand2);
+extern int calculate_instruction_length(const OpcodeInfo *opcode, const Operand *operands, int num_operands);
 
 /**
  * @brief Validates operands for an instruction (handles source and destination).
- * This function integrates the specific operand type checks required by the assembler.
- * @param opcode The instruction's opcode.
- * @param operand1_str The string for the first operand.
- * @param operand2_str The string for the second operand.
+ * Only the parsed addressing modes are checked; the operand text is not read again.
+ * @param ctx The assembly context (error flag and diagnostics stream).
+ * @param opcode Descriptor of the instruction's opcode.
+ * @param operands The parsed operands (a single operand is stored first).
  * @param num_operands_found The number of operands found in the line (0, 1, or 2).
  * @param line_num The current line number for error reporting.
- * @return 1 on success, 0 on failure (error detected and g_has_error set).
+ * @return 1 on success, 0 on failure (error detected and ctx->has_error set).
  */
-int validate_instruction_operands(const char* opcode, const char* operand1_str, const char* operand2_str, int num_operands_found, int line_num);
+int validate_instruction_operands(AssemblerContext *ctx, const OpcodeInfo *opcode, const Operand *operands, int num_operands_found, int line_num);
 
 
 /*
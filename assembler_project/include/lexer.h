@@ -0,0 +1,157 @@
+/* lexer.h */
+/**
+ * @file lexer.h
+ * @brief Declares the table-driven lexer that splits source lines into tokens.
+ *
+ * Every character is classified through one 256-entry table, so the scanners
+ * below make a single pass over a line without sscanf, strtok or repeated
+ * strlen calls. Tokens point into the line they were read from; they are not
+ * null-terminated and stay valid only as long as that line.
+ */
+
+#ifndef LEXER_H
+#define LEXER_H
+
+/* --- Character classes (bits of lexCharClass entries) --- */
+#define CHAR_SPACE        0x01 /**< isspace() characters, skipped between tokens. */
+#define CHAR_DIGIT        0x02 /**< '0'-'9'. */
+#define CHAR_SIGN         0x04 /**< '+' and '-'. */
+#define CHAR_LINE_END     0x08 /**< '\0', '\r' and '\n': the end of a line's text. */
+#define CHAR_WORD_END     0x10 /**< '\0' and the CHAR_SPACE characters: end a command word. */
+#define CHAR_OPERAND_END  0x20 /**< '\0', ' ', '\t' and ',': end an operand. */
+
+/** @brief Character class of every byte value (CHAR_* bits). */
+extern const unsigned char lexCharClass[256];
+
+/** @brief Tests whether character 'c' belongs to any of the classes in 'classes'. */
+#define CHAR_IS(c, classes) (lexCharClass[(unsigned char)(c)] & (classes))
+
+/**
+ * @brief Kind of a token.
+ */
+typedef enum TokenType {
+    TOKEN_END,          /**< No token: end of line (or an empty operand field). */
+    TOKEN_LABEL,        /**< Label definition: the text before the line's colon. */
+    TOKEN_OPCODE,       /**< Instruction mnemonic; value is its Opcode. */
+    TOKEN_DIRECTIVE,    /**< Word starting with '.'. */
+    TOKEN_WORD,         /**< Any other command word. */
+    TOKEN_IMMEDIATE,    /**< Operand starting with '#'; value is the number after it (0 if there is none). */
+    TOKEN_REGISTER,     /**< r0-r7; value is the register number. */
+    TOKEN_MATRIX,       /**< Operand containing '['. */
+    TOKEN_NUMBER,       /**< Signed decimal integer; value is the number. */
+    TOKEN_SYMBOL,       /**< Any other operand (a label reference). */
+    TOKEN_STRING        /**< Quoted string; text excludes the quotes, value is 0 if the closing quote is missing. */
+} TokenType;
+
+/**
+ * @brief A token: a typed slice of a source line.
+ */
+typedef struct Token {
+    TokenType type;     /**< Kind of the token. */
+    const char *text;   /**< First character of the token (not null-terminated). */
+    int length;         /**< Number of characters in 'text'. */
+    int value;          /**< Numeric value for TOKEN_OPCODE, TOKEN_IMMEDIATE, TOKEN_REGISTER, TOKEN_NUMBER and TOKEN_STRING. */
+} Token;
+
+/**
+ * @brief Cursor over one source line.
+ */
+typedef struct Lexer {
+    const char *pos;    /**< Next character to scan; the line ends at its '\0'. */
+} Lexer;
+
+/**
+ * @brief Starts lexing a line. The line is cut at its first '\r' or '\n'.
+ * @param lx The lexer to initialize.
+ * @param line The line (modified in place).
+ */
+void initLexer(Lexer *lx, char *line);
+
+/**
+ * @brief Skips whitespace.
+ * @param lx The lexer.
+ * @return The next character of the line ('\0' at its end).
+ */
+char lexSkipSpace(Lexer *lx);
+
+/**
+ * @brief Checks whether only whitespace remains on the line.
+ * @param lx The lexer.
+ * @return 1 at the end of the line, 0 otherwise.
+ */
+int lexAtEnd(Lexer *lx);
+
+/**
+ * @brief Reads a label definition: if the rest of the line contains a colon,
+ * everything before the first colon (after leading whitespace) is the label.
+ * @param lx The lexer; on success it is left just after the colon.
+ * @param tok Receives a TOKEN_LABEL (possibly empty or holding invalid characters).
+ * @return 1 if a colon was found, 0 otherwise (only leading whitespace is skipped).
+ */
+int lexLabel(Lexer *lx, Token *tok);
+
+/**
+ * @brief Reads a whitespace-delimited word, classified as an opcode, a directive
+ * or a plain word.
+ * @param lx The lexer.
+ * @param tok Receives the word.
+ * @return 1 if a word was read, 0 at the end of the line.
+ */
+int lexWord(Lexer *lx, Token *tok);
+
+/**
+ * @brief Reads the next field of a comma-separated list.
+ * Runs of commas separate fields and leading or trailing commas are ignored. A
+ * field's token is its first run of characters up to a blank or comma; the rest
+ * of the field is skipped. The token is classified as an immediate, register,
+ * matrix, number or symbol operand, or TOKEN_END for a field holding only whitespace.
+ * @param lx The lexer; it is left after the field's terminating comma.
+ * @param tok Receives the field's token.
+ * @return 1 if a field was read, 0 if no field remains.
+ */
+int lexField(Lexer *lx, Token *tok);
+
+/**
+ * @brief Reads a quoted string that ends at the last quote of the line.
+ * @param lx The lexer; it is left after the closing quote (or at the end of the line).
+ * @param tok Receives a TOKEN_STRING; its value is 0 if there is no closing quote.
+ * @return 1 if the next character is a quote, 0 otherwise.
+ */
+int lexString(Lexer *lx, Token *tok);
+
+/**
+ * @brief Reads matrix dimensions of the form "[rows][cols]"; whitespace may
+ * surround each bracket and number.
+ * @param lx The lexer; on success it is left after the second ']'.
+ * @param rows Receives the number of rows.
+ * @param cols Receives the number of columns.
+ * @return 1 on success, 0 if the text does not match.
+ */
+int lexMatrixDimensions(Lexer *lx, int *rows, int *cols);
+
+/**
+ * @brief Reads the index registers of a matrix operand of the form "LABEL[rX][rY]".
+ * The label must not be empty; anything after the second register is ignored.
+ * @param tok A TOKEN_MATRIX token.
+ * @param row Receives the number after the first 'r' (not range checked).
+ * @param col Receives the number after the second 'r' (not range checked).
+ * @return 1 on success, 0 if the operand is malformed.
+ */
+int lexMatrixRegisters(const Token *tok, int *row, int *col);
+
+/**
+ * @brief Compares a token's text with a string.
+ * @param tok The token.
+ * @param s Null-terminated string.
+ * @return 1 if they are equal, 0 otherwise.
+ */
+int tokenEquals(const Token *tok, const char *s);
+
+/**
+ * @brief Copies a token's text as a null-terminated string.
+ * @param tok The token.
+ * @param buffer Receives the text; must hold tok->length + 1 characters.
+ */
+void copyTokenText(const Token *tok, char *buffer);
+
+#endif
@@ -0,0 +1,99 @@
+/* line_reader.h */
+/**
+ * @file line_reader.h
+ * @brief Declares a line iterator over a whole source file held in memory.
+ *
+ * The file is mapped with mmap (or read into a buffer where mapping is not
+ * possible), so every stage that scans it walks the same bytes without asking
+ * the kernel again. Lines are returned as views into that memory; nothing is
+ * copied until a stage needs a modifiable, null-terminated copy.
+ */
+
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <stddef.h> /* For size_t */
+
+/**
+ * @brief The contents of one source file and the current read position.
+ */
+typedef struct LineReader {
+    const char *data;   /**< File contents (not null-terminated); NULL if the file is empty. */
+    size_t size;        /**< Number of bytes in 'data'. */
+    size_t pos;         /**< Offset of the next unread byte. */
+    int line_number;    /**< Number of lines returned so far. */
+    int mapped;         /**< 1 if 'data' is an mmap of the file, 0 if it is a malloc'd copy. */
+} LineReader;
+
+/**
+ * @brief A view of one line inside a LineReader.
+ */
+typedef struct SourceLine {
+    const char *text;   /**< First character of the line (not null-terminated). */
+    size_t length;      /**< Number of characters, including the '\n' if there is one. */
+    int number;         /**< 1-based number of the line. */
+    int at_eof;         /**< 1 if the input ended before a '\n' or the length limit was reached. */
+} SourceLine;
+
+/**
+ * @brief Loads a file for line-by-line reading.
+ * @param reader The reader to initialize.
+ * @param path Path of the file.
+ * @return 1 on success, 0 if the file cannot be opened or read.
+ */
+int openLineReader(LineReader *reader, const char *path);
+
+/**
+ * @brief Reads lines from text that is already in memory (e.g. expanded source).
+ * @param reader The reader to initialize.
+ * @param data A malloc'd buffer; the reader takes ownership and frees it on close.
+ * @param size Number of bytes in 'data'.
+ */
+void openLineReaderFromBuffer(LineReader *reader, char *data, size_t size);
+
+/**
+ * @brief Creates a reader over part of another reader's contents, e.g. one chunk
+ * of a source parsed in parallel. The slice shares the memory and must not be closed.
+ * @param reader The reader that owns the contents.
+ * @param start Offset of the first byte of the slice.
+ * @param end Offset just past the last byte of the slice.
+ * @param slice Receives the reader; its line numbers continue from reader->line_number.
+ */
+void sliceLineReader(const LineReader *reader, size_t start, size_t end, LineReader *slice);
+
+/**
+ * @brief Returns the next line, split exactly where fgets with a buffer of
+ * max_length + 1 characters would split it: a longer line is returned in pieces.
+ * @param reader The reader.
+ * @param max_length Maximum number of characters per line (including the '\n').
+ * @param line Receives the view of the line.
+ * @return 1 if a line was returned, 0 at the end of the input.
+ */
+int readLine(LineReader *reader, size_t max_length, SourceLine *line);
+
+/**
+ * @brief Copies a line into a null-terminated buffer, exactly as fgets would have stored it.
+ * @param line The line to copy.
+ * @param buffer Destination of at least line->length + 1 characters.
+ */
+void copySourceLine(const SourceLine *line, char *buffer);
+
+/**
+ * @brief Skips the remainder of the current line, up to and including its '\n'.
+ * @param reader The reader.
+ */
+void skipRestOfLine(LineReader *reader);
+
+/**
+ * @brief Moves back to the first line; the contents are not read again.
+ * @param reader The reader.
+ */
+void rewindLineReader(LineReader *reader);
+
+/**
+ * @brief Unmaps or frees the file contents.
+ * @param reader The reader to close.
+ */
+void closeLineReader(LineReader *reader);
+
+#endif
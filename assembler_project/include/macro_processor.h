@@ -11,31 +11,66 @@
 #define MACRO_PROCESSOR_H
 
 #include "assembler.h" /* Include common definitions like Macro struct, MAX_SYMBOL_LENGTH */
+#include "line_reader.h" /* For LineReader */
 
 /**
- * @brief Reads macro definitions from the input file and stores them in a linked list.
- * Performs basic syntax checks for macro definitions.
- * @param input The input file pointer.
- * @return A pointer to the head of the Macro linked list, or NULL if no macros were found/processed.
+ * @brief The macro-expanded source of a file, allocated once at its final size.
  */
-Macro* processMacroDefinitions(FILE* input);
-char* expandMacroInLine(const char* line, Macro* macroList);
+typedef struct ExpandedText {
+    char *data;         /**< Expanded text (not null-terminated); NULL while empty. */
+    size_t size;        /**< Number of characters in 'data'. */
+} ExpandedText;
 
 /**
- * @brief Expands a single line of input. If the line is a macro call, it returns the expanded content.
- * Otherwise, it returns a duplicate of the original line.
- * The returned string is dynamically allocated and must be freed by the caller.
- * @param line The input line to expand.
- * @param macroList A pointer to the head of the Macro linked list.
- * @return A dynamically allocated string containing the expanded line(s), or a duplicate of the original line.
- * The returned string must be freed by the caller.
+ * @brief Initializes an empty macro table. Must be called before any other operation.
+ * @param table Pointer to the MacroTable to initialize.
  */
-char* expandMacros(const char* line, Macro* macroList);
+void initMacroTable(MacroTable *table);
 
 /**
- * @brief Frees all dynamically allocated memory for the Macro linked list and its contents.
- * @param head A pointer to the head of the Macro linked list.
+ * @brief Searches for a macro by name (one hash probe sequence).
+ * @param table Pointer to the macro table.
+ * @param name The name of the macro to find.
+ * @return A pointer to the Macro structure if found, otherwise NULL.
  */
-void freeMacroList(Macro* head);
+Macro* findMacro(const MacroTable *table, const char *name);
+
+/**
+ * @brief Expands the macros of a source file in a single scan.
+ * Macro definitions are collected and removed, and every call is replaced by
+ * the macro body (with its label, if any) - including calls that appear before
+ * the macro is defined. A file without the "mcro" keyword is only checked for
+ * overlong lines. Macros are allocated from ctx->arena.
+ * @param ctx The assembly context (error flag and diagnostics stream).
+ * @param input Reader over the input file (read from its start).
+ * @param output Receives the expanded text, i.e. the .am contents; its malloc'd buffer belongs to the caller.
+ * @return 1 on success, 0 if errors were reported (output is then left empty).
+ */
+int preprocessMacros(AssemblerContext *ctx, LineReader *input, ExpandedText *output);
+
+/**
+ * @brief Expands the macros of a source file (see preprocessMacros) and writes the result to a stream.
+ * @param ctx The assembly context (error flag and diagnostics stream).
+ * @param input Reader over the input file.
+ * @param output Stream that receives the expanded text.
+ * @return 1 on success, 0 on failure.
+ */
+int create_expanded_file(AssemblerContext *ctx, LineReader* input, FILE* output);
+
+/**
+ * @brief Returns the body of a macro: its content lines separated by '\n'.
+ * @param table The macro table holding the macro.
+ * @param macro The macro.
+ * @return The first of macro->body_length characters (not null-terminated).
+ */
+const char* getMacroBody(const MacroTable *table, const Macro *macro);
+
+/**
+ * @brief Frees the hash index and the body pool; the table is left empty.
+ * The Macro structures are allocated from the file's arena (AssemblerContext::arena)
+ * and are released by freeArena instead.
+ * @param table Pointer to the macro table.
+ */
+void freeMacroTable(MacroTable *table);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+/* opcodes.h */
+/**
+ * @file opcodes.h
+ * @brief Declares the static opcode descriptor table.
+ *
+ * Every property of an instruction that depends only on its opcode (number,
+ * operand count, legal addressing modes) is kept in one table indexed by the
+ * Opcode value. A mnemonic is resolved to its descriptor once per source line.
+ */
+
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include "assembler.h" /* Includes the Opcode and AddressingMode enums */
+
+#define NUM_OPCODES 16 /**< Number of instructions in the machine's instruction set. */
+
+/** @brief Bit of an AddressingMode in an OpcodeInfo mode mask. */
+#define MODE_MASK(mode) (1 << (mode))
+
+/**
+ * @brief Describes one instruction of the instruction set.
+ */
+typedef struct OpcodeInfo {
+    const char *name;           /**< Mnemonic, e.g. "mov". */
+    int num_operands;           /**< Number of operands the instruction takes (0-2). */
+    unsigned char src_modes;    /**< Legal source modes (MODE_MASK bits); 0 if there is no source operand. */
+    unsigned char dest_modes;   /**< Legal destination (or single operand) modes; 0 if there are no operands. */
+} OpcodeInfo;
+
+/**
+ * @brief Finds the opcode of a mnemonic.
+ * Dispatches on the first characters, so at most one string comparison is made.
+ * @param name The mnemonic to look up.
+ * @return The Opcode value (index into the descriptor table), or -1 if 'name' is not an opcode.
+ */
+int findOpcode(const char *name);
+
+/**
+ * @brief Returns the descriptor of an opcode.
+ * @param opcode An Opcode value (0 to NUM_OPCODES - 1).
+ * @return Pointer to the static descriptor.
+ */
+const OpcodeInfo* getOpcodeInfo(int opcode);
+
+#endif
@@ -8,10 +8,44 @@
  * Performs the second pass of the assembler.
  * Iterates through the instruction list, resolves symbol references,
  * generates final machine code, and collects external symbol usages.
+ * @param ctx The assembly context (error flag, diagnostics and progress streams).
  * @param instructionList A pointer to the head of the Instruction linked list (populated in first pass).
- * @param symTab A pointer to the head of the Symbol linked list (finalized in first pass).
- * @return 1 if the second pass completed successfully, 0 otherwise (if g_has_error is set).
+ * @param symTab A pointer to the symbol table (finalized in first pass).
+ * @return 1 if the second pass completed successfully, 0 otherwise (if ctx->has_error is set).
  */
-int secondPass(Instruction *instructionList, Symbol *symTab);
+int secondPass(AssemblerContext *ctx, Instruction *instructionList, SymbolTable *symTab);
+
+/**
+ * Encodes a single instruction into machine code.
+ * @param ctx The assembly context (error flag and diagnostics stream).
+ * @param inst The instruction to encode.
+ * @param symTab The symbol table used to resolve label operands.
+ * @param fixups If non-NULL, label words and encoding errors are deferred into this table instead of resolved (one-pass mode).
+ * @param line_num The original source line number for error reporting.
+ */
+void encode_instruction_words(AssemblerContext *ctx, Instruction *inst, SymbolTable *symTab, FixupTable *fixups, int line_num);
+
+/**
+ * Initializes an empty fixup table for one-pass assembly.
+ * @param fixups The table to initialize.
+ */
+void initFixupTable(FixupTable *fixups);
+
+/**
+ * Frees the memory held by a fixup table.
+ * @param fixups The table to free.
+ */
+void freeFixupTable(FixupTable *fixups);
+
+/**
+ * Completes one-pass assembly: patches the label words deferred by the first pass,
+ * reports its deferred encoding errors in address order and validates that every
+ * entry symbol was defined.
+ * @param ctx The assembly context (error flag, diagnostics and progress streams).
+ * @param fixups The fixup table populated by firstPass.
+ * @param symTab The symbol table (finalized in first pass).
+ * @return 1 on success, 0 otherwise (if ctx->has_error is set).
+ */
+int resolveFixups(AssemblerContext *ctx, FixupTable *fixups, SymbolTable *symTab);
 
 #endif
\ No newline at end of file
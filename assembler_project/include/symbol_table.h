@@ -5,7 +5,7 @@
  *
  * It defines the interface for adding, finding, and freeing symbols,
  * as well as specific functions for updating data symbol addresses
- * and adding external symbol usages.
+ * and recording external symbol references.
  */
 
 #ifndef SYMBOL_TABLE_H
@@ -16,55 +16,91 @@
 
 /* --- Function Prototypes --- */
 
+/**
+ * @brief Initializes an empty symbol table. Must be called before any other operation.
+ * @param table Pointer to the SymbolTable to initialize.
+ */
+void initSymbolTable(SymbolTable *table);
+
+/**
+ * @brief Computes the FNV-1a hash of a symbol name.
+ * Shared by every name-keyed hash index (symbols and macros).
+ * @param name The null-terminated name to hash.
+ * @return The hash value (never depends on table capacity).
+ */
+unsigned long hashSymbolName(const char *name);
+
 /**
  * @brief Adds a new symbol to the symbol table.
  * Handles checks for reserved keywords, invalid label syntax, and duplicate definitions,
- * including specific rules for EXTERNAL and ENTRY symbols.
- * @param head Pointer to the head of the Symbol linked list (will be updated if new symbol is added at head).
+ * including specific rules for EXTERNAL and ENTRY symbols. Symbols that become
+ * SYMBOL_ENTRY are added to the table's entry index.
+ * @param ctx The assembly context (error flag and diagnostics stream).
+ * @param table Pointer to the symbol table.
  * @param name The name of the symbol.
  * @param address The memory address associated with the symbol.
  * @param type The type of the symbol (CODE, DATA, EXTERNAL, ENTRY).
  * @param line_num The line number in the source file where the symbol is defined/declared (for error reporting).
  */
-void addSymbol(Symbol **head, const char* name, int address, SymbolType type, int line_num);
+void addSymbol(AssemblerContext *ctx, SymbolTable *table, const char* name, int address, SymbolType type, int line_num);
+
+/**
+ * @brief Marks an existing symbol as an entry point (SYMBOL_ENTRY) and adds it
+ * to the table's entry index.
+ * @param table Pointer to the symbol table that owns 'sym'.
+ * @param sym The symbol (a symbol that is already SYMBOL_ENTRY is left as is).
+ */
+void markEntrySymbol(SymbolTable *table, Symbol *sym);
+
+/**
+ * @brief Searches for a symbol by name in the symbol table (one hash probe sequence).
+ * @param table Pointer to the symbol table.
+ * @param name The name of the symbol to find.
+ * @return A pointer to the Symbol structure if found, otherwise NULL.
+ */
+Symbol* findSymbol(SymbolTable *table, const char* name);
 
 /**
- * @brief Searches for a symbol by name in the symbol table.
- * @param head Pointer to the head of the Symbol linked list.
+ * @brief Alias of findSymbol, kept for callers that use the older name.
+ * @param table Pointer to the symbol table.
  * @param name The name of the symbol to find.
  * @return A pointer to the Symbol structure if found, otherwise NULL.
  */
-Symbol* findSymbol(Symbol* head, const char* name);
+Symbol* getSymbol(SymbolTable *table, const char* name);
 
 /**
- * @brief Frees the entire symbol table, including all Symbol structures
- * and any associated external usage lists.
- * @param head Pointer to the head of the Symbol linked list.
+ * @brief Frees the hash index, entry index and external references of the symbol table and empties it.
+ * Symbols and their names are allocated from the file's arena
+ * (AssemblerContext::arena) and are released by freeArena instead.
+ * The table is left empty and may be reused.
+ * @param table Pointer to the symbol table.
  */
-void freeSymbolTable(Symbol* head);
+void freeSymbolTable(SymbolTable *table);
 
 /**
  * @brief Updates the addresses of SYMBOL_DATA entries by adding the final
  * Instruction Counter (ICF) value. This is done at the end of the first pass.
- * @param head Pointer to the head of the Symbol linked list.
+ * @param table Pointer to the symbol table.
  * @param icf The final Instruction Counter value from the first pass.
  */
-void updateDataSymbolsAddresses(Symbol *head, int icf);
+void updateDataSymbolsAddresses(SymbolTable *table, int icf);
 
 /**
  * @brief Adds a usage address for an external symbol.
  * Called during the second pass when an external symbol is referenced.
- * The address is added to the `external_usages` linked list within the Symbol structure.
+ * The (symbol, address) pair is appended to the table's external references.
+ * @param ctx The assembly context (error flag and diagnostics stream).
+ * @param table Pointer to the symbol table that owns 'sym'.
  * @param sym A pointer to the Symbol structure (must be of type SYMBOL_EXTERNAL).
  * @param address The memory address (IC value) where the external symbol is referenced.
  */
-void addExternalUsage(Symbol *sym, int address);
+void addExternalUsage(AssemblerContext *ctx, SymbolTable *table, Symbol *sym, int address);
 
 /**
  * @brief Prints the contents of the symbol table to stdout for debugging purposes.
- * @param head Pointer to the head of the Symbol linked list.
+ * @param table Pointer to the symbol table.
  */
-void printSymbolTable(Symbol* head);
+void printSymbolTable(SymbolTable *table);
 
 
 
@@ -0,0 +1,32 @@
+/* thread_pool.h */
+/**
+ * @file thread_pool.h
+ * @brief Declares a minimal worker pool for running independent tasks in parallel.
+ *
+ * Tasks are identified by an index; workers take the next unclaimed index until
+ * all have been run. The pool lives only for the duration of one call.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/**
+ * @brief A unit of work: called once for each task index.
+ * @param arg The shared argument passed to runParallelTasks.
+ * @param index The index of the task to run (0 <= index < count).
+ */
+typedef void (*ParallelTask)(void *arg, int index);
+
+/**
+ * @brief Runs task(arg, i) for every i in [0, count) on up to num_threads threads.
+ * Indices are claimed in increasing order and the calling thread takes part in the work.
+ * The call returns once every task has finished. With num_threads <= 1, or if threads
+ * cannot be created, the remaining tasks run on the calling thread.
+ * @param num_threads Maximum number of threads working at once (including the caller).
+ * @param count Number of tasks.
+ * @param task The function to run for each index.
+ * @param arg Argument passed unchanged to every call of 'task'.
+ */
+void runParallelTasks(int num_threads, int count, ParallelTask task, void *arg);
+
+#endif
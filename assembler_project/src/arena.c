@@ -0,0 +1,130 @@
+/* arena.c */
+/**
+ * @file arena.c
+ * @brief Implements the per-file bump allocator.
+ *
+ * Each chunk is one malloc'd block: the ArenaChunk header followed by its data.
+ * Allocations advance a cursor in the newest chunk; when it is full a new chunk
+ * twice the size of the previous one is added (up to ARENA_MAX_CHUNK_SIZE), so a
+ * file needs only a handful of malloc calls however many nodes it creates.
+ */
+
+#include "arena.h"
+#include <stdio.h>  /* For fprintf, stderr */
+#include <stdlib.h> /* For malloc, free, exit */
+#include <string.h> /* For strlen, memcpy */
+
+/**
+ * @brief Strictest alignment any arena object may need.
+ */
+typedef union ArenaAlign {
+    long l;
+    double d;
+    void *p;
+} ArenaAlign;
+
+#define ARENA_ALIGNMENT sizeof(ArenaAlign)
+#define ARENA_ROUND_UP(n) (((n) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT)
+
+/* Chunk data starts after the header, rounded up so it is aligned as well */
+#define ARENA_HEADER_SIZE ARENA_ROUND_UP(sizeof(ArenaChunk))
+
+/**
+ * @brief Initializes an empty arena. No memory is reserved until the first allocation.
+ * @param arena Pointer to the Arena to initialize.
+ */
+void initArena(Arena *arena) {
+    arena->chunks = NULL;
+    arena->next_size = ARENA_INITIAL_CHUNK_SIZE;
+}
+
+/**
+ * @brief Allocates 'size' bytes from the arena, aligned for any object type.
+ * @param arena Pointer to the arena.
+ * @param size Number of bytes requested.
+ * @return Pointer to the allocated block, valid until freeArena.
+ */
+void* arenaAlloc(Arena *arena, size_t size) {
+    ArenaChunk *chunk = arena->chunks;
+    size_t chunk_size;
+    char *block;
+
+    size = ARENA_ROUND_UP(size ? size : 1);
+
+    if (!chunk || chunk->size - chunk->used < size) {
+        /* Oversized requests get a chunk of their own */
+        chunk_size = arena->next_size;
+        if (chunk_size < size) {
+            chunk_size = size;
+        }
+        chunk = (ArenaChunk *)malloc(ARENA_HEADER_SIZE + chunk_size);
+        if (!chunk) {
+            fprintf(stderr, "Memory allocation error for arena chunk.\n");
+            exit(1); /* Critical error, terminate program */
+        }
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+
+        if (arena->next_size < ARENA_MAX_CHUNK_SIZE) {
+            arena->next_size *= 2;
+        }
+    }
+
+    block = (char *)chunk + ARENA_HEADER_SIZE + chunk->used;
+    chunk->used += size;
+    return block;
+}
+
+/**
+ * @brief Copies a null-terminated string into the arena.
+ * @param arena Pointer to the arena.
+ * @param str The string to copy.
+ * @return Pointer to the copy, valid until freeArena.
+ */
+const char* arenaStrdup(Arena *arena, const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = (char *)arenaAlloc(arena, len);
+
+    memcpy(copy, str, len);
+    return copy;
+}
+
+/**
+ * @brief Moves every chunk of one arena into another.
+ * @param dest Arena that takes over the chunks.
+ * @param src Arena to empty.
+ */
+void moveArena(Arena *dest, Arena *src) {
+    ArenaChunk *last;
+
+    if (!src->chunks) {
+        return;
+    }
+    /* The destination keeps allocating from its own newest chunk */
+    for (last = src->chunks; last->next; last = last->next)
+        ;
+    if (dest->chunks) {
+        last->next = dest->chunks->next;
+        dest->chunks->next = src->chunks;
+    } else {
+        dest->chunks = src->chunks;
+    }
+    initArena(src);
+}
+
+/**
+ * @brief Releases every chunk of the arena at once.
+ * @param arena Pointer to the arena.
+ */
+void freeArena(Arena *arena) {
+    ArenaChunk *next_chunk;
+
+    while (arena->chunks) {
+        next_chunk = arena->chunks->next;
+        free(arena->chunks);
+        arena->chunks = next_chunk;
+    }
+    initArena(arena);
+}
@@ -1,92 +1,49 @@
 #include "convertToBase4.h"
-#include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
 #define WORD_SIZE 10    /* 10 bits per word in our machine */
 #define BASE4_LENGTH 5  /* 10 bits = 5 base-4 digits */
 
+/*
+ * Base-4 text of every 10-bit word, built at compile time.
+ * Each level appends one more digit to the string literal prefix 'p', so
+ * BASE4_DIGITS_5("") expands to "aaaaa", "aaaab", ..., "ddddd" in numeric order.
+ */
+#define BASE4_DIGITS_1(p) p "a", p "b", p "c", p "d"
+#define BASE4_DIGITS_2(p) BASE4_DIGITS_1(p "a"), BASE4_DIGITS_1(p "b"), BASE4_DIGITS_1(p "c"), BASE4_DIGITS_1(p "d")
+#define BASE4_DIGITS_3(p) BASE4_DIGITS_2(p "a"), BASE4_DIGITS_2(p "b"), BASE4_DIGITS_2(p "c"), BASE4_DIGITS_2(p "d")
+#define BASE4_DIGITS_4(p) BASE4_DIGITS_3(p "a"), BASE4_DIGITS_3(p "b"), BASE4_DIGITS_3(p "c"), BASE4_DIGITS_3(p "d")
+#define BASE4_DIGITS_5(p) BASE4_DIGITS_4(p "a"), BASE4_DIGITS_4(p "b"), BASE4_DIGITS_4(p "c"), BASE4_DIGITS_4(p "d")
+
+static const char base4_table[1 << WORD_SIZE][BASE4_LENGTH + 1] = { BASE4_DIGITS_5("") };
+
 /**
- * Converts a 10-bit value to a base-4 representation.
- * The function ensures a fixed length of 5 digits, padding with 'a' (zero) if necessary.
- * It handles negative numbers using 10-bit two's complement.
+ * Converts a 10-bit value to a base-4 representation in a caller-provided buffer.
+ * The result always has 5 digits, padded with 'a' (zero).
+ * Negative numbers use 10-bit two's complement.
  *
  * @param value The integer value to convert.
- * @return A dynamically allocated string with the base-4 representation (always 5 characters).
+ * @param out Buffer of at least BASE4_WORD_LENGTH + 1 characters.
  */
-char* convertToBase4(int value) {
-    char temp[BASE4_LENGTH + 1];
-    char *result;
-    int i;
-    
+void convertToBase4Buffer(int value, char *out) {
     /* Mask to 10 bits to handle both positive and negative numbers correctly */
-    value &= 0x3FF;  /* 0x3FF = 1111111111 in binary (10 bits) */
-    
-    /* Convert from right to left (least significant digit first) */
-    for (i = BASE4_LENGTH - 1; i >= 0; i--) {
-        int digit = value & 0x3;  /* Get the last 2 bits */
-        
-        /* Convert 2-bit value to base-4 character */
-        switch(digit) {
-            case 0: temp[i] = 'a'; break;
-            case 1: temp[i] = 'b'; break;
-            case 2: temp[i] = 'c'; break;
-            case 3: temp[i] = 'd'; break;
-        }
-        
-        value >>= 2;  /* Shift right by 2 bits for the next digit */
-    }
-    
-    temp[BASE4_LENGTH] = '\0';  /* Null-terminate the temporary string */
-    
-    /* Allocate memory for the final result and copy the temporary string. */
-    /* The spec requires a fixed-width output (5 digits for 10 bits), so we don't remove leading 'a's. */
-    result = malloc(BASE4_LENGTH + 1);
-    if (!result) {
-        fprintf(stderr, "Memory allocation error in convertToBase4\n");
-        exit(1);
-    }
-    
-    strcpy(result, temp);
-    
-    return result;
+    memcpy(out, base4_table[value & 0x3FF], BASE4_LENGTH + 1);
 }
 
 /**
- * @brief Strips leading 'a' characters from a base-4 string.
- * 
- * This function creates a new string without leading 'a's (zeros).
- * If the string is all 'a's, it returns a single 'a'.
- * Used primarily for formatting the header in the object file.
+ * @brief Skips leading 'a' characters of a base-4 string without copying it.
+ * If the string is all 'a's, the last 'a' is kept.
  * 
  * @param base4_str The base-4 string to strip
- * @return A dynamically allocated string without leading 'a's.
- *         The caller must free this memory.
+ * @return Pointer into 'base4_str' at the first digit to print.
  */
-char* stripLeadingA(const char* base4_str) {
+const char* skipLeadingA(const char* base4_str) {
     const char* start = base4_str;
-    char* result;
-    size_t len;
-    
-    if (!base4_str) return NULL;
     
     /* Skip leading 'a' characters, but keep at least one */
     while (*start == 'a' && *(start + 1) != '\0') {
         start++;
     }
-    
-    /* Calculate length of result */
-    len = strlen(start);
-    
-    /* Allocate memory for result */
-    result = (char*)malloc((len + 1) * sizeof(char));
-    if (!result) {
-        fprintf(stderr, "Memory allocation error in stripLeadingA\n");
-        return NULL;
-    }
-    
-    /* Copy the stripped string */
-    strcpy(result, start);
-    
-    return result;
-}
\ No newline at end of file
+    return start;
+}
+
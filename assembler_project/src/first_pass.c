@@ -10,24 +10,26 @@
  * 4. Prepares data structures for the second pass
  */
 
-#define _POSIX_C_SOURCE 200809L
+#define _POSIX_C_SOURCE 200809L /* For open_memstream */
 #include "first_pass.h"
+#include "arena.h"
+#include "opcodes.h"
+#include "lexer.h"
+#include "thread_pool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
 /* --- External Dependencies --- */
-/* Global error flag - set when any error occurs during assembly */
-extern int g_has_error;
-
 /* Symbol table management functions from symbol_table.c */
-extern void addSymbol(Symbol **head, const char *name, int address, SymbolType type, int line_num);
-extern Symbol* findSymbol(Symbol *head, const char *name);
-extern void updateDataSymbolsAddresses(Symbol *head, int icf);
+extern void addSymbol(AssemblerContext *ctx, SymbolTable *table, const char *name, int address, SymbolType type, int line_num);
+extern Symbol* findSymbol(SymbolTable *table, const char *name);
+extern void markEntrySymbol(SymbolTable *table, Symbol *sym);
+extern void updateDataSymbolsAddresses(SymbolTable *table, int icf);
 
-/* Base-4 conversion function from second_pass.c */
-extern char* get_addressing_mode_base4(const char* operand);
+/* Instruction encoder from second_pass.c (used directly in one-pass mode) */
+extern void encode_instruction_words(AssemblerContext *ctx, Instruction *inst, SymbolTable *symTab, FixupTable *fixups, int line_num);
 
 /* --- Local Helper Function Prototypes --- */
 char* skip_whitespace(char* s);
@@ -35,10 +37,11 @@ int is_valid_number(const char *s);
 int is_opcode(const char* s);
 int is_register(const char* s);
 int is_valid_label(const char* s);
-static int validate_data_parameters(char *params_str, int line_num, DataItem **temp_data_head, int *DC_ptr);
-static int validate_string_parameters(char *params_str, int line_num, DataItem **temp_data_head, int *DC_ptr);
-static int validate_mat_parameters(char *params_str, int line_num, DataItem **temp_data_head, int *DC_ptr);
-int validate_instruction_operands(const char* opcode, const char* operand1_str, const char* operand2_str, int num_operands_found, int line_num);
+static int validate_data_parameters(AssemblerContext *ctx, Lexer *lx, int line_num, DataSegment *data);
+static int validate_string_parameters(AssemblerContext *ctx, Lexer *lx, int line_num, DataSegment *data);
+static int validate_mat_parameters(AssemblerContext *ctx, Lexer *lx, int line_num, DataSegment *data);
+int validate_instruction_operands(AssemblerContext *ctx, const OpcodeInfo *opcode, const Operand *operands, int num_operands_found, int line_num);
+static int parse_operand(AssemblerContext *ctx, const Token *tok, Operand *op);
 
 /* --- Helper Functions Implementations --- */
 
@@ -80,20 +83,7 @@ int is_valid_number(const char *s) {
  * @return 1 if valid opcode, 0 otherwise
  */
 int is_opcode(const char* s) {
-    /* Array of all valid opcodes in our assembly language */
-    const char *opcodes[] = {
-        "mov", "cmp", "add", "sub", "not", "clr", "lea", "inc", "dec", "jmp", "bne",
-        "red", "prn", "jsr", "rts", "stop", NULL
-    };
-    int i;
-    
-    /* Compare with each valid opcode */
-    for (i = 0; opcodes[i]; i++) {
-        if (strcmp(s, opcodes[i]) == 0) {
-            return 1;
-        }
-    }
-    return 0;
+    return findOpcode(s) >= 0;
 }
 
 /**
@@ -140,245 +130,285 @@ int is_valid_label(const char* s) {
 
 /**
  * Calculates the number of memory words an instruction will occupy
- * @param opcode The instruction opcode
- * @param op1 First operand (may be NULL)
- * @param op2 Second operand (may be NULL)
+ * @param opcode Descriptor of the instruction's opcode
+ * @param operands Parsed operands
+ * @param num_operands Number of operands found
  * @return Number of words needed, or -1 on error
  */
-int calculate_instruction_length(const char* opcode, const char* op1, const char* op2) {
-    int expected_operands = -1;
-    int m_dummy, n_dummy;  /* For matrix parsing */
+int calculate_instruction_length(const OpcodeInfo *opcode, const Operand *operands, int num_operands) {
     int length = 1;  /* Base instruction always takes 1 word */
-    int num_operands_parsed = 0;
-    int op1_is_reg = 0, op2_is_reg = 0;
-    int op1_extra_words = 0, op2_extra_words = 0;
-
-    /* Count how many operands were provided */
-    if (op1 && op1[0] != '\0') num_operands_parsed++;
-    if (op2 && op2[0] != '\0') num_operands_parsed++;
-
-    /* Determine expected operand count based on opcode */
-    /* No operand instructions */
-    if (strcmp(opcode, "rts") == 0 || strcmp(opcode, "stop") == 0) 
-        expected_operands = 0;
-    /* Single operand instructions */
-    else if (strcmp(opcode, "not") == 0 || strcmp(opcode, "clr") == 0 ||
-             strcmp(opcode, "inc") == 0 || strcmp(opcode, "dec") == 0 ||
-             strcmp(opcode, "jmp") == 0 || strcmp(opcode, "bne") == 0 ||
-             strcmp(opcode, "jsr") == 0 || strcmp(opcode, "red") == 0 ||
-             strcmp(opcode, "prn") == 0)
-        expected_operands = 1;
-    /* Two operand instructions */
-    else if (strcmp(opcode, "mov") == 0 || strcmp(opcode, "cmp") == 0 ||
-             strcmp(opcode, "add") == 0 || strcmp(opcode, "sub") == 0 ||
-             strcmp(opcode, "lea") == 0)
-        expected_operands = 2;
+    int i;
 
     /* Validate operand count */
-    if (expected_operands == -1 || expected_operands != num_operands_parsed)
+    if (opcode->num_operands != num_operands)
         return -1;
 
-    /* Calculate extra words needed for first operand */
-    if (num_operands_parsed >= 1) {
-        if (op1[0] == '#') {
-            /* Immediate addressing - needs 1 extra word */
-            op1_extra_words = 1;
-        } else if (strchr(op1, '[')) {
-            /* Matrix addressing - needs 2 extra words for indices */
-            if (sscanf(op1, "%*[^[][r%d][r%d]", &m_dummy, &n_dummy) == 2) {
-                op1_extra_words = 2;
-            } else {
-                return -1;  /* Invalid matrix format */
-            }
-        } else if (is_register(op1)) {
-            /* Register addressing */
-            op1_is_reg = 1;
-            op1_extra_words = 1;
-        } else {
-            /* Direct addressing (label) - needs 1 extra word */
-            op1_extra_words = 1;
-        }
+    /* Special case: two registers can share one word */
+    if (num_operands == 2 && operands[0].mode == ADDR_REGISTER && operands[1].mode == ADDR_REGISTER) {
+        return length + 1;  /* Base + 1 word for both registers */
     }
 
-    /* Calculate extra words needed for second operand */
-    if (num_operands_parsed == 2) {
-        if (op2[0] == '#') {
-            /* Immediate addressing */
-            op2_extra_words = 1;
-        } else if (strchr(op2, '[')) {
-            /* Matrix addressing */
-            if (sscanf(op2, "%*[^[][r%d][r%d]", &m_dummy, &n_dummy) == 2) {
-                op2_extra_words = 2;
-            } else {
-                return -1;
-            }
-        } else if (is_register(op2)) {
-            /* Register addressing */
-            op2_is_reg = 1;
-            op2_extra_words = 1;
-        } else {
-            /* Direct addressing (label) */
-            op2_extra_words = 1;
+    /* A matrix needs 2 extra words (label and indices), every other mode 1 */
+    for (i = 0; i < num_operands; i++) {
+        length += operands[i].mode == ADDR_MATRIX ? 2 : 1;
+    }
+    return length;
+}
+
+/**
+ * Converts an operand token into its parsed form
+ * Label texts are copied into the file's arena; matrix registers outside r0-r7
+ * are stored as -1 and reported when the instruction is encoded
+ * @param ctx Assembly context (owns the arena)
+ * @param tok Operand token read by lexField
+ * @param op Output operand
+ * @return 1 on success, 0 for a malformed matrix operand
+ */
+static int parse_operand(AssemblerContext *ctx, const Token *tok, Operand *op) {
+    int row, col;
+    char *text;
+    const char *bracket;
+
+    switch (tok->type) {
+    case TOKEN_IMMEDIATE:
+        op->mode = ADDR_IMMEDIATE;
+        op->value.immediate = tok->value;
+        return 1;
+    case TOKEN_REGISTER:
+        op->mode = ADDR_REGISTER;
+        op->value.reg = (unsigned char)tok->value;
+        return 1;
+    default: /* Direct label or matrix */
+        op->mode = tok->type == TOKEN_MATRIX ? ADDR_MATRIX : ADDR_DIRECT;
+        text = (char *)arenaAlloc(&ctx->arena, (size_t)tok->length + 1);
+        copyTokenText(tok, text);
+        bracket = (const char *)memchr(tok->text, '[', (size_t)tok->length);
+        op->value.label.text = text;
+        op->value.label.length = (unsigned char)(bracket ? bracket - tok->text : tok->length);
+        op->value.label.row_reg = -1;
+        op->value.label.col_reg = -1;
+        if (op->mode != ADDR_MATRIX) return 1;
+        if (!lexMatrixRegisters(tok, &row, &col)) return 0;
+        if (row >= 0 && row <= 7) op->value.label.row_reg = (signed char)row;
+        if (col >= 0 && col <= 7) op->value.label.col_reg = (signed char)col;
+        return 1;
+    }
+}
+
+/**
+ * Initializes an empty data segment
+ * @param data Data segment to initialize
+ */
+void initDataSegment(DataSegment *data) {
+    data->words = NULL;
+    data->stored = 0;
+    data->capacity = 0;
+    data->runs = NULL;
+    data->num_runs = 0;
+    data->runs_capacity = 0;
+    data->count = 0;
+}
+
+/**
+ * Frees the words and zero runs of a data segment and leaves it empty
+ * @param data Data segment
+ */
+void freeDataSegment(DataSegment *data) {
+    free(data->words);
+    free(data->runs);
+    initDataSegment(data);
+}
+
+/**
+ * Adds explicit words at the end of the data segment (the data counter is its length)
+ * @param data Data segment
+ * @param count Number of words to add
+ * @return The first new word; the words are not initialized
+ */
+static int16_t* extend_data_segment(DataSegment *data, int count) {
+    int new_capacity;
+    int16_t *grown;
+    int16_t *words;
+
+    if (data->stored + count > data->capacity) {
+        new_capacity = data->capacity ? data->capacity : INITIAL_DATA_SEGMENT_CAPACITY;
+        while (data->stored + count > new_capacity) {
+            new_capacity *= 2;  /* Double capacity */
         }
+        grown = (int16_t *)realloc(data->words, (size_t)new_capacity * sizeof(int16_t));
+        if (!grown) {
+            fprintf(stderr, "Memory allocation error for data segment.\n");
+            exit(1); /* Critical error, terminate program */
+        }
+        data->words = grown;
+        data->capacity = new_capacity;
     }
+    words = data->words + data->stored;
+    data->stored += count;
+    data->count += count;
+    return words;
+}
 
-    /* Special case: two registers can share one word */
-    if (op1_is_reg && op2_is_reg) {
-        return length + 1;  /* Base + 1 word for both registers */
+/**
+ * Adds entries at the end of the data segment's zero runs
+ * @param data Data segment
+ * @param count Number of runs to add
+ * @return The first new run; the runs are not initialized
+ */
+static ZeroRun* extend_zero_runs(DataSegment *data, int count) {
+    int new_capacity;
+    ZeroRun *grown;
+    ZeroRun *runs;
+
+    if (data->num_runs + count > data->runs_capacity) {
+        new_capacity = data->runs_capacity ? data->runs_capacity : INITIAL_ZERO_RUN_CAPACITY;
+        while (data->num_runs + count > new_capacity) {
+            new_capacity *= 2;  /* Double capacity */
+        }
+        grown = (ZeroRun *)realloc(data->runs, (size_t)new_capacity * sizeof(ZeroRun));
+        if (!grown) {
+            fprintf(stderr, "Memory allocation error for data segment.\n");
+            exit(1); /* Critical error, terminate program */
+        }
+        data->runs = grown;
+        data->runs_capacity = new_capacity;
     }
+    runs = data->runs + data->num_runs;
+    data->num_runs += count;
+    return runs;
+}
 
-    /* Calculate total length */
-    length += op1_extra_words + op2_extra_words;
+/**
+ * Adds zero words at the end of the data segment. Fills of at least
+ * MIN_ZERO_RUN_LENGTH words are recorded as a zero run instead of being stored.
+ * @param data Data segment
+ * @param count Number of zero words to add
+ */
+static void add_zero_words(DataSegment *data, int count) {
+    ZeroRun *run;
 
-    /* Sanity check - instruction shouldn't exceed 5 words */
-    if (length > 5) {
-        return -1;
+    if (count < MIN_ZERO_RUN_LENGTH) {
+        memset(extend_data_segment(data, count), 0, (size_t)count * sizeof(int16_t));
+        return;
     }
-    return length;
+
+    /* Extend the last run if it ends right here */
+    run = data->num_runs > 0 ? &data->runs[data->num_runs - 1] : NULL;
+    if (!run || run->offset + run->count != data->count) {
+        run = extend_zero_runs(data, 1);
+        run->offset = data->count;
+        run->count = 0;
+    }
+    run->count += count;
+    data->count += count;
 }
 
 /**
  * Validates and processes .data directive parameters
- * Parses comma-separated integers and adds them to data list
- * @param params_str Parameter string after .data
+ * Parses comma-separated integers and adds them to the data segment
+ * @param ctx Assembly context (error flag and diagnostics stream)
+ * @param lx Lexer positioned after .data
  * @param line_num Line number for error reporting
- * @param temp_data_head Head of temporary data list
- * @param DC_ptr Pointer to data counter
+ * @param data Data segment that receives the values
  * @return 1 on success, 0 on error
  */
-static int validate_data_parameters(char *params_str, int line_num, DataItem **temp_data_head, int *DC_ptr) {
-    char *token;
-    char *rest = params_str;
+static int validate_data_parameters(AssemblerContext *ctx, Lexer *lx, int line_num, DataSegment *data) {
+    Token token;
     int success = 1;
-    char *trimmed;
     int value;
-    DataItem *newData;
 
     /* Check for empty parameters */
-    if (params_str == NULL || *skip_whitespace(params_str) == '\0') {
-        fprintf(stderr, "Error at line %d: Missing parameters for .data directive.\n", line_num);
-        g_has_error = 1; 
+    if (lexAtEnd(lx)) {
+        fprintf(ctx->err, "Error at line %d: Missing parameters for .data directive.\n", line_num);
+        ctx->has_error = 1; 
         return 0;
     }
 
     /* Check for leading comma */
-    rest = skip_whitespace(rest);
-    if (*rest == ',') {
-        fprintf(stderr, "Error at line %d: Leading comma in .data directive parameters.\n", line_num);
+    if (*lx->pos == ',') {
+        fprintf(ctx->err, "Error at line %d: Leading comma in .data directive parameters.\n", line_num);
         success = 0;
-        rest++;
+        lx->pos++;
     }
 
     /* Parse each comma-separated value */
-    while ((token = strtok_r(rest, ",", &rest))) {
-        /* Trim whitespace from token */
-        trimmed = skip_whitespace(token);
-        trimmed[strcspn(trimmed, " \t")] = '\0';
-
-        /* Check for empty token (consecutive commas) */
-        if (strlen(trimmed) == 0) {
-            fprintf(stderr, "Error at line %d: Invalid empty parameter or multiple consecutive commas in .data.\n", line_num);
+    while (lexField(lx, &token)) {
+        /* Check for empty field (consecutive commas) */
+        if (token.type == TOKEN_END) {
+            fprintf(ctx->err, "Error at line %d: Invalid empty parameter or multiple consecutive commas in .data.\n", line_num);
             success = 0;
             continue;
         }
 
         /* Validate number format */
-        if (!is_valid_number(trimmed)) {
-            fprintf(stderr, "Error at line %d: Invalid number '%s' in .data directive.\n", line_num, trimmed);
+        if (token.type != TOKEN_NUMBER) {
+            fprintf(ctx->err, "Error at line %d: Invalid number '%.*s' in .data directive.\n", line_num, token.length, token.text);
             success = 0;
             continue;
         }
         
-        /* Parse the integer value */
-        value = atoi(trimmed);
+        /* The lexer has already parsed the integer value */
+        value = token.value;
 
         /* Check value range (-512 to 511 for 10-bit numbers) */
         if (value < -512 || value > 511) {
-            fprintf(stderr, "Error at line %d: Data value %d out of range [-512, 511] in .data directive.\n", line_num, value);
+            fprintf(ctx->err, "Error at line %d: Data value %d out of range [-512, 511] in .data directive.\n", line_num, value);
             success = 0;
             continue;
         }
 
-        /* Create new data item and add to list */
-        newData = (DataItem *)malloc(sizeof(DataItem));
-        if (!newData) { 
-            exit(1); 
-        }
-        newData->address = (*DC_ptr)++;  /* Assign address and increment counter */
-        newData->value = value;
-        newData->next = *temp_data_head;  /* Add to front of list */
-        *temp_data_head = newData;
+        /* Store the value at the next data address */
+        *extend_data_segment(data, 1) = (int16_t)value;
     }
 
     if (!success) 
-        g_has_error = 1;
+        ctx->has_error = 1;
     return success;
 }
 
 /**
  * Validates and processes .string directive parameters
- * Converts string to individual character values in data list
- * @param params_str Parameter string after .string
+ * Converts string to individual character values in the data segment
+ * @param ctx Assembly context (error flag and diagnostics stream)
+ * @param lx Lexer positioned after .string
  * @param line_num Line number for error reporting
- * @param temp_data_head Head of temporary data list
- * @param DC_ptr Pointer to data counter
+ * @param data Data segment that receives the characters
  * @return 1 on success, 0 on error
  */
-static int validate_string_parameters(char *params_str, int line_num, DataItem **temp_data_head, int *DC_ptr) {
-    char *start = skip_whitespace(params_str);
-    char *end;
-    char *str_content;
-    DataItem *newData;
-    DataItem *nullTerm;
+static int validate_string_parameters(AssemblerContext *ctx, Lexer *lx, int line_num, DataSegment *data) {
+    Token str;
+    int i;
+    int16_t *words;
 
     /* String must start with quote */
-    if (*start != '"') {
-        fprintf(stderr, "Error at line %d: String must begin with a quote.\n", line_num);
-        g_has_error = 1; 
+    if (!lexString(lx, &str)) {
+        fprintf(ctx->err, "Error at line %d: String must begin with a quote.\n", line_num);
+        ctx->has_error = 1; 
         return 0;
     }
 
-    /* Find closing quote */
-    end = strrchr(start + 1, '"');
-    if (!end) {
-        fprintf(stderr, "Error at line %d: String must end with a quote.\n", line_num);
-        g_has_error = 1; 
+    /* The string ends at the last quote of the line */
+    if (!str.value) {
+        fprintf(ctx->err, "Error at line %d: String must end with a quote.\n", line_num);
+        ctx->has_error = 1; 
         return 0;
     }
 
     /* Check for text after closing quote */
-    if (*skip_whitespace(end + 1) != '\0') {
-        fprintf(stderr, "Error at line %d: Extraneous text after string.\n", line_num);
-        g_has_error = 1; 
+    if (!lexAtEnd(lx)) {
+        fprintf(ctx->err, "Error at line %d: Extraneous text after string.\n", line_num);
+        ctx->has_error = 1; 
         return 0;
     }
 
-    /* Extract string content (between quotes) */
-    *end = '\0';
-    str_content = start + 1;
-
-    /* Add each character as a data item */
-    while (*str_content) {
-        newData = (DataItem *)malloc(sizeof(DataItem));
-        if (!newData) { 
-            exit(1); 
-        }
-        newData->address = (*DC_ptr)++;
-        newData->value = (int)*str_content;  /* ASCII value of character */
-        newData->next = *temp_data_head;
-        *temp_data_head = newData;
-        str_content++;
+    /* Add each character as a data word */
+    words = extend_data_segment(data, str.length + 1);
+    for (i = 0; i < str.length; i++) {
+        words[i] = (int16_t)str.text[i];  /* ASCII value of character */
     }
 
     /* Add null terminator */
-    nullTerm = (DataItem *)malloc(sizeof(DataItem));
-    if (!nullTerm) { 
-        exit(1); 
-    }
-    nullTerm->address = (*DC_ptr)++;
-    nullTerm->value = 0;  /* Null terminator */
-    nullTerm->next = *temp_data_head;
-    *temp_data_head = nullTerm;
+    words[str.length] = 0;
 
     return 1;
 }
@@ -386,88 +416,83 @@ static int validate_string_parameters(char *params_str, int line_num, DataItem *
 /**
  * Validates and processes .mat (matrix) directive parameters
  * Parses matrix dimensions and initial values
- * @param params_str Parameter string after .mat
+ * @param ctx Assembly context (error flag and diagnostics stream)
+ * @param lx Lexer positioned after .mat
  * @param line_num Line number for error reporting
- * @param temp_data_head Head of temporary data list
- * @param DC_ptr Pointer to data counter
+ * @param data Data segment that receives the cells
  * @return 1 on success, 0 on error
  */
-static int validate_mat_parameters(char *params_str, int line_num, DataItem **temp_data_head, int *DC_ptr) {
+static int validate_mat_parameters(AssemblerContext *ctx, Lexer *lx, int line_num, DataSegment *data) {
     int success = 1;
     int rows, cols;
-    int read_count_dims;
-    char *current_val_pos = skip_whitespace(params_str);
     int numCells;
     int count_initialized_values = 0;
-    char *num_start_ptr;
-    char *num_end_ptr;
+    const char *num_end_ptr;
     char num_str_val[MAX_LINE_LENGTH];
     size_t num_len;
     int value;
-    DataItem *newData;
+    char next;
 
     /* Parse matrix dimensions [rows][cols] */
-    if (sscanf(current_val_pos, " [ %d ] [ %d ]%n", &rows, &cols, &read_count_dims) != 2) {
-        fprintf(stderr, "Error at line %d: Invalid or missing matrix dimensions. Expected '[rows][cols]'.\n", line_num);
-        g_has_error = 1; 
+    if (!lexMatrixDimensions(lx, &rows, &cols)) {
+        fprintf(ctx->err, "Error at line %d: Invalid or missing matrix dimensions. Expected '[rows][cols]'.\n", line_num);
+        ctx->has_error = 1; 
         return 0;
     }
 
     /* Move past the dimensions */
-    current_val_pos += read_count_dims;
-    current_val_pos = skip_whitespace(current_val_pos);
+    lexSkipSpace(lx);
 
     /* Validate dimensions are positive */
     if (rows <= 0 || cols <= 0) {
-        fprintf(stderr, "Error at line %d: Matrix dimensions must be positive integers.\n", line_num);
-        g_has_error = 1; 
+        fprintf(ctx->err, "Error at line %d: Matrix dimensions must be positive integers.\n", line_num);
+        ctx->has_error = 1; 
         return 0;
     }
 
     /* Calculate total cells in matrix */
     numCells = rows * cols;
-    num_start_ptr = current_val_pos;
 
     /* Check for leading comma */
-    if (*num_start_ptr == ',') {
-        fprintf(stderr, "Error at line %d: Leading comma in .mat initialization parameters.\n", line_num);
+    if (*lx->pos == ',') {
+        fprintf(ctx->err, "Error at line %d: Leading comma in .mat initialization parameters.\n", line_num);
         success = 0;
-        num_start_ptr++;
+        lx->pos++;
     }
-    num_start_ptr = skip_whitespace(num_start_ptr);
+    lexSkipSpace(lx);
 
     /* Parse initialization values */
-    while (*num_start_ptr != '\0' && count_initialized_values < numCells) {
-        num_end_ptr = num_start_ptr;
+    while (*lx->pos != '\0' && count_initialized_values < numCells) {
+        num_end_ptr = lx->pos;
         
         /* Handle sign */
-        if (*num_end_ptr == '+' || *num_end_ptr == '-') 
+        if (CHAR_IS(*num_end_ptr, CHAR_SIGN)) 
             num_end_ptr++;
         
         /* Check for valid digit */
-        if (!isdigit((unsigned char)*num_end_ptr)) {
-            fprintf(stderr, "Error at line %d: Invalid character in .mat initialization. Expected a number.\n", line_num);
+        if (!CHAR_IS(*num_end_ptr, CHAR_DIGIT)) {
+            fprintf(ctx->err, "Error at line %d: Invalid character in .mat initialization. Expected a number.\n", line_num);
             success = 0; 
             break;
         }
         
         /* Find end of number */
-        while (isdigit((unsigned char)*num_end_ptr)) 
+        while (CHAR_IS(*num_end_ptr, CHAR_DIGIT)) 
             num_end_ptr++;
 
         /* Extract number string */
-        num_len = num_end_ptr - num_start_ptr;
+        num_len = num_end_ptr - lx->pos;
         if (num_len == 0 || num_len >= MAX_LINE_LENGTH) {
-            fprintf(stderr, "Error at line %d: Invalid number format or length in .mat.\n", line_num);
+            fprintf(ctx->err, "Error at line %d: Invalid number format or length in .mat.\n", line_num);
             success = 0; 
             break;
         }
-        strncpy(num_str_val, num_start_ptr, num_len);
+        strncpy(num_str_val, lx->pos, num_len);
         num_str_val[num_len] = '\0';
 
         /* Validate and parse number */
         if (!is_valid_number(num_str_val)) {
-            fprintf(stderr, "Error at line %d: Invalid number format in .mat initialization: '%s'.\n", line_num, num_str_val);
+            fprintf(ctx->err, "Error at line %d: Invalid number format in .mat initialization: '%s'.\n", line_num, num_str_val);
             success = 0; 
             break;
         }
@@ -475,500 +500,686 @@ static int validate_mat_parameters(char *params_str, int line_num, DataItem **te
 
         /* Check value range */
         if (value < -512 || value > 511) {
-            fprintf(stderr, "Error at line %d: Data value %d out of range [-512, 511] in .mat directive.\n", line_num, value);
+            fprintf(ctx->err, "Error at line %d: Data value %d out of range [-512, 511] in .mat directive.\n", line_num, value);
             success = 0; 
             break;
         }
 
-        /* Add value to data list */
-        newData = (DataItem *)malloc(sizeof(DataItem));
-        if (!newData) { 
-            exit(1); 
-        }
-        newData->address = (*DC_ptr)++;
-        newData->value = value;
-        newData->next = *temp_data_head;
-        *temp_data_head = newData;
+        /* Add value to the data segment */
+        *extend_data_segment(data, 1) = (int16_t)value;
         count_initialized_values++;
 
         /* Move to next value */
-        num_start_ptr = num_end_ptr;
-        num_start_ptr = skip_whitespace(num_start_ptr);
+        lx->pos = num_end_ptr;
 
         /* Handle comma separator */
-        if (*num_start_ptr == ',') {
-            num_start_ptr++;
-            num_start_ptr = skip_whitespace(num_start_ptr);
+        next = lexSkipSpace(lx);
+        if (next == ',') {
+            lx->pos++;
+            next = lexSkipSpace(lx);
             
             /* Check for trailing comma */
-            if (*num_start_ptr == '\0') {
-                fprintf(stderr, "Error at line %d: Trailing comma in .mat initialization parameters.\n", line_num);
+            if (next == '\0') {
+                fprintf(ctx->err, "Error at line %d: Trailing comma in .mat initialization parameters.\n", line_num);
                 success = 0; 
                 break;
             }
             
             /* Check for consecutive commas */
-            if (*num_start_ptr == ',') {
-                fprintf(stderr, "Error at line %d: Multiple consecutive commas in .mat initialization parameters.\n", line_num);
+            if (next == ',') {
+                fprintf(ctx->err, "Error at line %d: Multiple consecutive commas in .mat initialization parameters.\n", line_num);
                 success = 0; 
                 break;
             }
-        } else if (*num_start_ptr != '\0') {
+        } else if (next != '\0') {
             /* Missing comma between values */
-            fprintf(stderr, "Error at line %d: Expected comma or end of line after number in .mat initialization.\n", line_num);
+            fprintf(ctx->err, "Error at line %d: Expected comma or end of line after number in .mat initialization.\n", line_num);
             success = 0; 
             break;
         }
     }
 
     /* Fill remaining cells with zeros */
-    while (count_initialized_values < numCells) {
-        newData = (DataItem *)malloc(sizeof(DataItem));
-        if (!newData) { 
-            exit(1); 
-        }
-        newData->address = (*DC_ptr)++;
-        newData->value = 0;  /* Default value */
-        newData->next = *temp_data_head;
-        *temp_data_head = newData;
-        count_initialized_values++;
+    if (count_initialized_values < numCells) {
+        add_zero_words(data, numCells - count_initialized_values);
     }
 
     /* Warn about extra values */
-    if (success && *num_start_ptr != '\0') {
-        fprintf(stderr, "Warning at line %d: Extraneous text or too many initialization values for .mat directive. Excess values ignored.\n", line_num);
+    if (success && *lx->pos != '\0') {
+        fprintf(ctx->err, "Warning at line %d: Extraneous text or too many initialization values for .mat directive. Excess values ignored.\n", line_num);
     }
 
     if (!success) 
-        g_has_error = 1;
+        ctx->has_error = 1;
     return success;
 }
 
 /**
  * Validates instruction operands against allowed addressing modes
- * Each instruction has specific allowed addressing modes for its operands
- * @param opcode The instruction opcode
- * @param op1 First operand string
- * @param op2 Second operand string  
+ * Each instruction has specific allowed addressing modes for its operands (see opcodes.c)
+ * @param ctx Assembly context (error flag and diagnostics stream)
+ * @param opcode Descriptor of the instruction's opcode
+ * @param operands Parsed operands
  * @param num_ops Number of operands found
  * @param line Line number for error reporting
  * @return 1 if valid, 0 if invalid
  */
-int validate_instruction_operands(const char* opcode, const char* op1, const char* op2, int num_ops, int line) {
-    int opcode_num = -1;
-    int expected_operands = 0;
-    char actual_src_mode_char;
-    char actual_dest_mode_char;
+int validate_instruction_operands(AssemblerContext *ctx, const OpcodeInfo *opcode, const Operand *operands, int num_ops, int line) {
+    int expected_operands = opcode->num_operands;
     int success = 1;
-    
-    /* Table of legal addressing modes for each instruction */
-    /* 'a'=immediate, 'b'=direct, 'c'=matrix, 'd'=register, 'X'=no operand */
-    const char* legal_modes[16][2]={
-        {"abcd", "bcd"}, /* mov - src: all modes, dest: no immediate */
-        {"abcd", "abcd"}, /* cmp - src: all modes, dest: all modes */
-        {"abcd", "bcd"}, /* add */
-        {"abcd", "bcd"}, /* sub */
-        {"X", "bcd"}, /* not - single operand */
-        {"X", "bcd"}, /* clr */
-        {"bc", "bcd"}, /* lea - src: no immediate/register */
-        {"X", "bcd"}, /* inc */
-        {"X", "bcd"}, /* dec */
-        {"X", "bc"}, /* jmp - no register */
-        {"X", "bc"}, /* bne */
-        {"X", "bcd"}, /* red */
-        {"X", "abcd"}, /* prn - can print anything */
-        {"X", "bc"}, /* jsr */
-        {"X", "X"}, /* rts - no operands */
-        {"X", "X"} /* stop - no operands */
-    };
-
-    /* Get addressing mode characters for operands */
-    actual_src_mode_char = get_addressing_mode_base4(op1)[0];
-    actual_dest_mode_char = get_addressing_mode_base4(op2)[0];
-
-    /* Map opcode string to number */
-    if (strcmp(opcode, "mov") == 0) opcode_num = 0;
-    else if (strcmp(opcode, "cmp") == 0) opcode_num = 1;
-    else if (strcmp(opcode, "add") == 0) opcode_num = 2;
-    else if (strcmp(opcode, "sub") == 0) opcode_num = 3;
-    else if (strcmp(opcode, "not") == 0) opcode_num = 4;
-    else if (strcmp(opcode, "clr") == 0) opcode_num = 5;
-    else if (strcmp(opcode, "lea") == 0) opcode_num = 6;
-    else if (strcmp(opcode, "inc") == 0) opcode_num = 7;
-    else if (strcmp(opcode, "dec") == 0) opcode_num = 8;
-    else if (strcmp(opcode, "jmp") == 0) opcode_num = 9;
-    else if (strcmp(opcode, "bne") == 0) opcode_num = 10;
-    else if (strcmp(opcode, "red") == 0) opcode_num = 11;
-    else if (strcmp(opcode, "prn") == 0) opcode_num = 12;
-    else if (strcmp(opcode, "jsr") == 0) opcode_num = 13;
-    else if (strcmp(opcode, "rts") == 0) opcode_num = 14;
-    else if (strcmp(opcode, "stop") == 0) opcode_num = 15;
-
-    /* Validate opcode was found */
-    if (opcode_num == -1) {
-        fprintf(stderr, "Internal Error: Unknown opcode '%s' in operand validation.\n", opcode);
-        g_has_error = 1; 
-        return 0;
-    }
-
-    /* Bounds check */
-    if (opcode_num >= (int)(sizeof(legal_modes) / sizeof(legal_modes[0]))) {
-        fprintf(stderr, "Internal Error: Opcode number %d out of bounds for legal_modes array.\n", opcode_num);
-        g_has_error = 1; 
-        return 0;
-    }
-    
-    /* Count expected operands based on legal modes table */
-    if (strcmp(legal_modes[opcode_num][0], "X") != 0) 
-        expected_operands++;
-    if (strcmp(legal_modes[opcode_num][1], "X") != 0) 
-        expected_operands++;
 
     /* Check operand count matches expectation */
     if (expected_operands != num_ops) {
-        fprintf(stderr, "Error at line %d: Instruction '%s' expects %d operands, but %d were found.\n", 
-                line, opcode, expected_operands, num_ops);
-        g_has_error = 1; 
+        fprintf(ctx->err, "Error at line %d: Instruction '%s' expects %d operands, but %d were found.\n", 
+                line, opcode->name, expected_operands, num_ops);
+        ctx->has_error = 1; 
         return 0;
     }
 
     /* Validate source operand addressing mode (for 2-operand instructions) */
     if (num_ops == 2) {
-        if (strchr(legal_modes[opcode_num][0], actual_src_mode_char) == NULL) {
-            fprintf(stderr, "Error at line %d: Illegal addressing mode for source operand of '%s'.\n", line, opcode);
+        if (!(opcode->src_modes & MODE_MASK(operands[0].mode))) {
+            fprintf(ctx->err, "Error at line %d: Illegal addressing mode for source operand of '%s'.\n", line, opcode->name);
             success = 0;
         }
     }
 
     /* Validate destination operand addressing mode */
     if (num_ops == 2) {
-        if (strchr(legal_modes[opcode_num][1], actual_dest_mode_char) == NULL) {
-            fprintf(stderr, "Error at line %d: Illegal addressing mode for destination operand of '%s'.\n", line, opcode);
+        if (!(opcode->dest_modes & MODE_MASK(operands[1].mode))) {
+            fprintf(ctx->err, "Error at line %d: Illegal addressing mode for destination operand of '%s'.\n", line, opcode->name);
             success = 0;
         }
     } else if (num_ops == 1) {
         /* For single operand, it's treated as destination */
-        if (strchr(legal_modes[opcode_num][1], actual_src_mode_char) == NULL) {
-            fprintf(stderr, "Error at line %d: Illegal addressing mode for operand of '%s'.\n", line, opcode);
+        if (!(opcode->dest_modes & MODE_MASK(operands[0].mode))) {
+            fprintf(ctx->err, "Error at line %d: Illegal addressing mode for operand of '%s'.\n", line, opcode->name);
             success = 0;
         }
     }
 
     if (!success) 
-        g_has_error = 1;
+        ctx->has_error = 1;
     return success;
 }
 
+/* --- Chunked first pass --- */
+
 /**
- * Main first pass function - processes the entire input file
- * Builds symbol table, validates syntax, creates instruction and data lists
- * @param input Input file pointer
- * @param symTab Pointer to symbol table head
- * @param instructionList Pointer to instruction list head
- * @param dataList Pointer to data list head
- * @param final_ic_out Output for final instruction counter
- * @param final_dc_out Output for final data counter
- * @return 1 on success, 0 if errors occurred
+ * @brief What one source line contributes to the file. Chunks record their lines
+ * in parallel; the records are then applied to the symbol table in source order.
  */
-int firstPass(FILE *input, Symbol **symTab, Instruction **instructionList, DataItem **dataList, int *final_ic_out, int *final_dc_out) {
-    /* All variable declarations at top for C90 compliance */
-    char line[MAX_LINE_LENGTH + 2];  /* +2 for newline and null */
-    int lineNumber = 0;
-    int IC = MEMORY_START, DC = 0;  /* Instruction and Data counters */
-    int c;
-    char *p;  /* Line parsing pointer */
-    char label_name[MAX_SYMBOL_LENGTH];
-    char *colon_pos;
-    char command_or_directive[MAX_SYMBOL_LENGTH];
-    int chars_read;
-    char extern_label_name[MAX_SYMBOL_LENGTH];
-    char entry_label_name[MAX_SYMBOL_LENGTH];
-    Symbol *s;
-    char op1_str[MAX_LINE_LENGTH], op2_str[MAX_LINE_LENGTH];
-    int num_ops_found;
-    char* rest_of_line;
-    char* tokenizer_state;
-    char* token;
-    Instruction *newInst;
-    int k;
-    /* Temporary lists built in reverse, then reversed at end */
-    Instruction *temp_i_head = NULL;
-    DataItem *temp_d_head = NULL;
-    /* For list reversal */
-    Instruction *prev_i = NULL, *curr_i = NULL, *next_i = NULL;
-    DataItem *prev_d = NULL, *curr_d = NULL, *next_d = NULL;
+typedef struct ParsedLine {
+    int line_number;        /* Line number in the expanded source */
+    int has_error;          /* The line itself reported an error */
+    long messages_end;      /* End of the line's diagnostics in the chunk's buffer */
+    const char *label;      /* Label defined by the line (arena copy), or NULL */
+    SymbolType label_type;  /* SYMBOL_DATA after a directive, SYMBOL_CODE otherwise */
+    const char *symbol;     /* Operand of .extern or .entry (arena copy), or NULL */
+    SymbolType symbol_type; /* SYMBOL_EXTERNAL or SYMBOL_ENTRY */
+    Instruction *inst;      /* Instruction of the line, or NULL */
+    int data_count;         /* Number of data words the line adds */
+} ParsedLine;
 
-    /* Initialize global error flag */
-    g_has_error = 0;
+/**
+ * @brief A slice of the expanded source, parsed independently of the others.
+ * Addresses inside a chunk start at 0 until the totals of the chunks before it are known.
+ */
+typedef struct FirstPassChunk {
+    LineReader lines;         /* View of the chunk's lines */
+    int line_count;           /* Number of lines the first pass reads from the chunk */
+    AssemblerContext ctx;     /* Own arena, diagnostics buffer and per-line error flag */
+    char *messages;           /* Diagnostics of all lines, in order */
+    size_t messages_size;
+    ParsedLine *lines_info;   /* Records of the lines that define, declare, emit or report something */
+    int count;
+    int capacity;
+    Instruction *inst_head;   /* Instructions of the chunk, in order */
+    Instruction *inst_tail;
+    DataSegment data;         /* Data words of the chunk; its length is the chunk's DC */
+    int ic;                   /* Total instruction words */
+    int ic_base;              /* Address of the chunk's first instruction word */
+    int dc_base;              /* Offset of the chunk's first data word */
+    int16_t *words_out;       /* Where the chunk's explicit data words go in the file's segment (NULL if none or already there) */
+    ZeroRun *runs_out;        /* Where the chunk's zero runs go in the file's segment (NULL if none or already there) */
+} FirstPassChunk;
 
-    /* Process input line by line */
-    while (fgets(line, sizeof(line), input) != NULL) {
-        lineNumber++;
-        
-        /* Initialize for this line */
-        label_name[0] = '\0';
-        op1_str[0] = '\0';
-        op2_str[0] = '\0';
-        num_ops_found = 0;
+/**
+ * Checks the line length limit on a line read with a limit of MAX_LINE_LENGTH + 1
+ * @param line The line
+ * @return 1 if the line is longer than MAX_LINE_LENGTH characters, 0 otherwise
+ */
+static int line_too_long(const SourceLine *line) {
+    /* A '\0' inside the line ends it as far as the parser is concerned */
+    return line->length > MAX_LINE_LENGTH && line->text[MAX_LINE_LENGTH] != '\n' &&
+           !memchr(line->text, '\0', line->length);
+}
 
-        /* Check line length limit */
-        if (strlen(line) > MAX_LINE_LENGTH && line[MAX_LINE_LENGTH] != '\n' && line[MAX_LINE_LENGTH] != '\0') {
-            fprintf(stderr, "Error at line %d: Line exceeds maximum length of %d characters.\n", lineNumber, MAX_LINE_LENGTH);
-            g_has_error = 1;
-            /* Skip rest of oversized line */
-            while ((c = fgetc(input)) != '\n' && c != EOF);
-            continue;
+/**
+ * Parses one line without touching the symbol table: labels and .extern/.entry
+ * operands are only recorded, instructions and data words get chunk-relative addresses
+ * @param ctx The chunk's context (arena, diagnostics and error flag)
+ * @param line The line (modified in place)
+ * @param lineNumber Number of the line
+ * @param rec Receives what the line contributes (cleared by the caller)
+ * @param inst_head Head of the chunk's instruction list
+ * @param inst_tail Last instruction of the chunk's list (new instructions are appended after it)
+ * @param IC Chunk instruction counter
+ * @param data Data segment of the chunk
+ */
+static void parse_line(AssemblerContext *ctx, char *line, int lineNumber, ParsedLine *rec,
+                       Instruction **inst_head, Instruction **inst_tail, int *IC, DataSegment *data) {
+    Lexer lx;  /* Cursor over the line */
+    Token label, command, field;
+    char label_name[MAX_SYMBOL_LENGTH];
+    char *symbol_name;
+    Token operand_tokens[2];
+    Operand operands[2];
+    int operands_ok;
+    int num_ops_found = 0;
+    int i;
+    Instruction *newInst;
+    int length;
+    int opcode;
+    const OpcodeInfo *opcode_info;
+
+    label_name[0] = '\0';
+
+    /* Remove newline characters and skip leading whitespace */
+    initLexer(&lx, line);
+
+    /* Skip empty lines and comments */
+    if (lexSkipSpace(&lx) == '\0' || *lx.pos == ';') 
+        return;
+
+    /* Check for label definition (ends with colon) */
+    if (lexLabel(&lx, &label)) {
+        /* Validate label */
+        if (label.length == 0) {
+            fprintf(ctx->err, "Error at line %d: Empty label definition.\n", lineNumber);
+            ctx->has_error = 1; 
+            return;
+        }
+        if (label.length >= MAX_SYMBOL_LENGTH) {
+            fprintf(ctx->err, "Error at line %d: Label name '%.*s' exceeds max length %d.\n", 
+                    lineNumber, label.length, label.text, MAX_SYMBOL_LENGTH - 1);
+            ctx->has_error = 1; 
+            return;
         }
-
-        /* Remove newline characters */
-        line[strcspn(line, "\r\n")] = '\0';
         
-        /* Skip leading whitespace */
-        p = skip_whitespace(line);
+        /* Extract label name */
+        copyTokenText(&label, label_name);
+    }
 
-        /* Skip empty lines and comments */
-        if (*p == '\0' || *p == ';') 
-            continue;
+    /* Parse command/directive */
+    if (!lexWord(&lx, &command)) {
+        if (label_name[0] != '\0') {
+            fprintf(ctx->err, "Error at line %d: Missing command/directive after label '%s'.\n", lineNumber, label_name);
+            ctx->has_error = 1;
+        }
+        return;
+    }
+    lexSkipSpace(&lx);
 
-        /* Check for label definition (ends with colon) */
-        colon_pos = strchr(p, ':');
-        if (colon_pos) {
-            size_t label_len = colon_pos - p;
-            
-            /* Validate label */
-            if (label_len == 0) {
-                fprintf(stderr, "Error at line %d: Empty label definition.\n", lineNumber);
-                g_has_error = 1; 
-                continue;
+    /* The label is defined when the record is merged: data labels at DC, code labels at IC */
+    if (label_name[0]) {
+        rec->label = arenaStrdup(&ctx->arena, label_name);
+        rec->label_type = command.type == TOKEN_DIRECTIVE ? SYMBOL_DATA : SYMBOL_CODE;
+    }
+
+    /* Process directives (start with '.') */
+    if (command.type == TOKEN_DIRECTIVE) {
+        /* Process each directive type */
+        if (tokenEquals(&command, ".data")) {
+            validate_data_parameters(ctx, &lx, lineNumber, data);
+        } else if (tokenEquals(&command, ".string")) {
+            validate_string_parameters(ctx, &lx, lineNumber, data);
+        } else if (tokenEquals(&command, ".mat")) {
+            validate_mat_parameters(ctx, &lx, lineNumber, data);
+        } else if (tokenEquals(&command, ".extern") || tokenEquals(&command, ".entry")) {
+            /* Label on .extern/.entry line is ignored */
+            if (label_name[0]) {
+                fprintf(ctx->err, "Warning at line %d: Label '%s' on %.*s directive is ignored.\n",
+                        lineNumber, label_name, command.length, command.text);
             }
-            if (label_len >= MAX_SYMBOL_LENGTH) {
-                fprintf(stderr, "Error at line %d: Label name '%.*s' exceeds max length %d.\n", 
-                        lineNumber, (int)label_len, p, MAX_SYMBOL_LENGTH - 1);
-                g_has_error = 1; 
-                continue;
+            /* The symbol is declared when the record is merged */
+            if (lexWord(&lx, &field)) {
+                symbol_name = (char *)arenaAlloc(&ctx->arena, (size_t)field.length + 1);
+                copyTokenText(&field, symbol_name);
+                rec->symbol = symbol_name;
+                rec->symbol_type = tokenEquals(&command, ".extern") ? SYMBOL_EXTERNAL : SYMBOL_ENTRY;
+            } else {
+                fprintf(ctx->err, "Error at line %d: Missing label for %.*s directive.\n",
+                        lineNumber, command.length, command.text); 
+                ctx->has_error = 1;
             }
-            
-            /* Extract label name */
-            strncpy(label_name, p, label_len);
-            label_name[label_len] = '\0';
-            
-            /* Move past the label */
-            p = skip_whitespace(colon_pos + 1);
+        } else {
+            fprintf(ctx->err, "Error at line %d: Unrecognized directive '%.*s'.\n", lineNumber, command.length, command.text); 
+            ctx->has_error = 1;
         }
+        return;
+    }
 
-        /* Parse command/directive */
-        if (sscanf(p, "%s%n", command_or_directive, &chars_read) != 1) {
-            if (label_name[0] != '\0') {
-                fprintf(stderr, "Error at line %d: Missing command/directive after label '%s'.\n", lineNumber, label_name);
-                g_has_error = 1;
-            }
-            continue;
+    /* Process instruction */
+
+    /* The lexer identified the opcode; its descriptor drives validation and encoding */
+    if (command.type != TOKEN_OPCODE) {
+        fprintf(ctx->err, "Error at line %d: Unrecognized instruction '%.*s'.\n", lineNumber, command.length, command.text); 
+        ctx->has_error = 1; 
+        return;
+    }
+    opcode = command.value;
+
+    /* Parse operands (comma-separated fields) */
+    
+    /* First operand */
+    if (lexField(&lx, &operand_tokens[0])) {
+        if (operand_tokens[0].type != TOKEN_END) {
+            num_ops_found = 1;
+        } else {
+            fprintf(ctx->err, "Error at line %d: Missing first operand or invalid comma usage.\n", lineNumber);
+            ctx->has_error = 1; 
+            return;
         }
-        p = skip_whitespace(p + chars_read);
 
-        /* Process directives (start with '.') */
-        if (command_or_directive[0] == '.') {
-            /* Add label for data directives */
-            if (label_name[0]) {
-                addSymbol(symTab, label_name, DC, SYMBOL_DATA, lineNumber);
-                if (g_has_error) continue;
+        /* Second operand */
+        if (lexField(&lx, &operand_tokens[1])) {
+            if (operand_tokens[1].type != TOKEN_END) {
+                num_ops_found = 2;
+            } else {
+                fprintf(ctx->err, "Error at line %d: Missing second operand after comma.\n", lineNumber);
+                ctx->has_error = 1; 
+                return;
             }
+        }
+    }
+    
+    /* Check for extra operands */
+    if (lexField(&lx, &field) && field.type != TOKEN_END) {
+        fprintf(ctx->err, "Error at line %d: Extraneous text or too many operands.\n", lineNumber);
+        ctx->has_error = 1; 
+        return;
+    }
 
-            /* Process each directive type */
-            if (strcmp(command_or_directive, ".data")==0) {
-                if (!validate_data_parameters(p, lineNumber, &temp_d_head, &DC)) 
-                    continue;
-            } else if (strcmp(command_or_directive, ".string")==0) {
-                if (!validate_string_parameters(p, lineNumber, &temp_d_head, &DC)) 
-                    continue;
-            } else if (strcmp(command_or_directive, ".mat")==0) {
-                if (!validate_mat_parameters(p, lineNumber, &temp_d_head, &DC)) 
-                    continue;
-            } else if (strcmp(command_or_directive, ".extern")==0) {
-                /* Label on .extern line is ignored */
-                if (label_name[0]) {
-                    fprintf(stderr, "Warning at line %d: Label '%s' on .extern directive is ignored.\n", lineNumber, label_name);
-                }
-                /* Extract and add external symbol */
-                if(sscanf(p, "%s", extern_label_name) == 1) {
-                    addSymbol(symTab, extern_label_name, 0, SYMBOL_EXTERNAL, lineNumber);
-                } else {
-                    fprintf(stderr, "Error at line %d: Missing label for .extern directive.\n", lineNumber); 
-                    g_has_error = 1;
-                }
-                if (g_has_error) continue;
-            } else if (strcmp(command_or_directive, ".entry")==0) {
-                /* Label on .entry line is ignored */
-                if (label_name[0]) {
-                    fprintf(stderr, "Warning at line %d: Label '%s' on .entry directive is ignored.\n", lineNumber, label_name);
-                }
-                /* Process entry point */
-                if(sscanf(p, "%s", entry_label_name) == 1) {
-                    s = findSymbol(*symTab, entry_label_name);
-                    if (s) {
-                        /* Check for conflict with external */
-                        if (s->type == SYMBOL_EXTERNAL) {
-                            fprintf(stderr, "Error at line %d: Symbol '%s' declared as .entry and .extern.\n", 
-                                    lineNumber, entry_label_name); 
-                            g_has_error = 1;
-                        } else {
-                            s->type = SYMBOL_ENTRY; 
-                        }
-                    } else {
-                        /* Add as entry (will be resolved in second pass) */
-                        addSymbol(symTab, entry_label_name, 0, SYMBOL_ENTRY, lineNumber);
-                    }
-                } else {
-                    fprintf(stderr, "Error at line %d: Missing label for .entry directive.\n", lineNumber); 
-                    g_has_error = 1;
-                }
-                if (g_has_error) continue;
-            } else {
-                fprintf(stderr, "Error at line %d: Unrecognized directive '%s'.\n", lineNumber, command_or_directive); 
-                g_has_error = 1;
+    /* Parse each operand once; validation, length and encoding use the result */
+    operands_ok = 1;
+    for (i = 0; i < num_ops_found; i++) {
+        if (!parse_operand(ctx, &operand_tokens[i], &operands[i])) operands_ok = 0;
+    }
+
+    /* Validate operands for this instruction */
+    opcode_info = getOpcodeInfo(opcode);
+    if (!validate_instruction_operands(ctx, opcode_info, operands, num_ops_found, lineNumber)) {
+        return;
+    }
+
+    /* Calculate instruction length (a malformed matrix operand has none) */
+    length = operands_ok ? calculate_instruction_length(opcode_info, operands, num_ops_found) : -1;
+    if (length == -1) {
+        fprintf(ctx->err, "Error at line %d: Failed to determine instruction length for '%.*s'.\n", lineNumber, command.length, command.text);
+        ctx->has_error = 1;
+        return;
+    }
+
+    /* Create instruction node */
+    newInst = (Instruction *)arenaAlloc(&ctx->arena, sizeof(Instruction));
+    
+    /* Initialize instruction with its parsed operands */
+    newInst->address = *IC;
+    newInst->original_line_number = lineNumber;
+    newInst->opcode = (unsigned char)opcode;
+    newInst->num_operands = (unsigned char)num_ops_found;
+    newInst->instruction_length = (unsigned char)length;
+    for (i = 0; i < num_ops_found; i++) {
+        newInst->operands[i] = operands[i];
+    }
+
+    /* Machine words are filled in the second pass (or when the record is merged in one-pass mode) */
+    newInst->num_operand_words = 0;
+    rec->inst = newInst;
+
+    /* Append to instruction list, keeping source order */
+    newInst->next = NULL;
+    if (*inst_tail) (*inst_tail)->next = newInst;
+    else *inst_head = newInst;
+    *inst_tail = newInst;
+    
+    /* Update instruction counter */
+    *IC += newInst->instruction_length;
+}
+
+/**
+ * Counts the lines the first pass reads from a chunk (an overlong line counts once)
+ * @param chunks_ptr The FirstPassChunk array
+ * @param index Index of the chunk
+ */
+static void count_chunk_lines(void *chunks_ptr, int index) {
+    FirstPassChunk *chunk = (FirstPassChunk *)chunks_ptr + index;
+    LineReader lines = chunk->lines;
+    SourceLine source_line;
+    int count = 0;
+
+    while (readLine(&lines, MAX_LINE_LENGTH + 1, &source_line)) {
+        count++;
+        if (line_too_long(&source_line)) {
+            skipRestOfLine(&lines);
+        }
+    }
+    chunk->line_count = count;
+}
+
+/**
+ * Parses every line of a chunk into its records, lists and message buffer
+ * @param chunks_ptr The FirstPassChunk array
+ * @param index Index of the chunk
+ */
+static void parse_chunk(void *chunks_ptr, int index) {
+    FirstPassChunk *chunk = (FirstPassChunk *)chunks_ptr + index;
+    AssemblerContext *ctx = &chunk->ctx;
+    char line[MAX_LINE_LENGTH + 2];  /* +2 for newline and null */
+    SourceLine source_line;
+    ParsedLine *rec;
+    long messages_start = 0;
+    int dc_before;
+
+    ctx->err = open_memstream(&chunk->messages, &chunk->messages_size);
+    if (!ctx->err) {
+        fprintf(stderr, "Memory allocation error for first pass messages.\n");
+        exit(1); /* Critical error, terminate program */
+    }
+
+    /* Process input line by line */
+    while (readLine(&chunk->lines, sizeof(line) - 1, &source_line)) {
+        if (chunk->count == chunk->capacity) {
+            chunk->capacity = chunk->capacity ? chunk->capacity * 2 : INITIAL_PARSED_LINE_CAPACITY;
+            chunk->lines_info = (ParsedLine *)realloc(chunk->lines_info, (size_t)chunk->capacity * sizeof(ParsedLine));
+            if (!chunk->lines_info) {
+                fprintf(stderr, "Memory allocation error for first pass line records.\n");
+                exit(1); /* Critical error, terminate program */
             }
+        }
+        rec = &chunk->lines_info[chunk->count];
+        memset(rec, 0, sizeof(ParsedLine));
+        rec->line_number = source_line.number;
+        ctx->has_error = 0;
+        dc_before = chunk->data.count;
+
+        /* Check line length limit */
+        if (line_too_long(&source_line)) {
+            fprintf(ctx->err, "Error at line %d: Line exceeds maximum length of %d characters.\n", source_line.number, MAX_LINE_LENGTH);
+            ctx->has_error = 1;
+            /* Skip rest of oversized line */
+            skipRestOfLine(&chunk->lines);
         } else {
-            /* Process instruction */
-            
-            /* Add label for code if present */
-            if (label_name[0]) {
-                addSymbol(symTab, label_name, IC, SYMBOL_CODE, lineNumber);
-                if (g_has_error) continue;
-            }
-            
-            /* Validate opcode */
-            if (!is_opcode(command_or_directive)) {
-                fprintf(stderr, "Error at line %d: Unrecognized instruction '%s'.\n", lineNumber, command_or_directive); 
-                g_has_error = 1; 
-                continue;
-            }
+            copySourceLine(&source_line, line);
+            parse_line(ctx, line, source_line.number, rec, &chunk->inst_head, &chunk->inst_tail, &chunk->ic, &chunk->data);
+        }
 
-            /* Parse operands (comma-separated) */
-            rest_of_line = p;
-            tokenizer_state = rest_of_line;
-            
-            /* First operand */
-            token = strtok_r(tokenizer_state, ",", &tokenizer_state);
-            if (token) {
-                char* trimmed_op1 = skip_whitespace(token);
-                trimmed_op1[strcspn(trimmed_op1, " \t")] = '\0';
-
-                if (strlen(trimmed_op1) > 0) {
-                    strncpy(op1_str, trimmed_op1, sizeof(op1_str) - 1);
-                    op1_str[sizeof(op1_str) - 1] = '\0';
-                    num_ops_found = 1;
-                } else {
-                    fprintf(stderr, "Error at line %d: Missing first operand or invalid comma usage.\n", lineNumber);
-                    g_has_error = 1; 
-                    continue;
-                }
-            }
+        rec->has_error = ctx->has_error;
+        rec->data_count = chunk->data.count - dc_before;
+        rec->messages_end = ftell(ctx->err);
 
-            /* Second operand */
-            token = strtok_r(NULL, ",", &tokenizer_state);
-            if (token) {
-                char* trimmed_op2;
-                if (num_ops_found == 0) {
-                    fprintf(stderr, "Error at line %d: Missing first operand before comma.\n", lineNumber);
-                    g_has_error = 1; 
-                    continue;
-                }
-                trimmed_op2 = skip_whitespace(token);
-                trimmed_op2[strcspn(trimmed_op2, " \t")] = '\0';
-
-                if (strlen(trimmed_op2) > 0) {
-                    strncpy(op2_str, trimmed_op2, sizeof(op2_str) - 1);
-                    op2_str[sizeof(op2_str) - 1] = '\0';
-                    num_ops_found = 2;
-                } else {
-                    fprintf(stderr, "Error at line %d: Missing second operand after comma.\n", lineNumber);
-                    g_has_error = 1; 
-                    continue;
-                }
-            }
-            
-            /* Check for extra operands */
-            token = strtok_r(NULL, ",", &tokenizer_state);
-            if (token && strlen(skip_whitespace(token)) > 0) {
-                fprintf(stderr, "Error at line %d: Extraneous text or too many operands.\n", lineNumber);
-                g_has_error = 1; 
-                continue;
-            }
+        /* Blank lines, comments and lines without effect need no record */
+        if (rec->has_error || rec->label || rec->symbol || rec->inst || rec->data_count ||
+            rec->messages_end != messages_start) {
+            chunk->count++;
+            messages_start = rec->messages_end;
+        }
+    }
+    fclose(ctx->err);
+}
+
+/**
+ * Moves a chunk's instructions from chunk-relative to final addresses and copies
+ * its data words and zero runs to their place in the file's data segment
+ * @param chunks_ptr The FirstPassChunk array
+ * @param index Index of the chunk
+ */
+static void relocate_chunk(void *chunks_ptr, int index) {
+    FirstPassChunk *chunk = (FirstPassChunk *)chunks_ptr + index;
+    Instruction *inst;
+    int i;
 
-            /* Validate operands for this instruction */
-            if (!validate_instruction_operands(command_or_directive, op1_str, op2_str, num_ops_found, lineNumber)) {
+    for (inst = chunk->inst_head; inst; inst = inst->next) {
+        inst->address += chunk->ic_base;
+    }
+    if (chunk->words_out) {
+        memcpy(chunk->words_out, chunk->data.words, (size_t)chunk->data.stored * sizeof(int16_t));
+    }
+    if (chunk->runs_out) {
+        for (i = 0; i < chunk->data.num_runs; i++) {
+            chunk->runs_out[i].offset = chunk->data.runs[i].offset + chunk->dc_base;
+            chunk->runs_out[i].count = chunk->data.runs[i].count;
+        }
+    }
+    if (chunk->words_out || chunk->runs_out) {
+        freeDataSegment(&chunk->data);
+    }
+}
+
+/**
+ * Declares the operand of an .extern or .entry line
+ * @param ctx The file's context
+ * @param symTab Pointer to the symbol table
+ * @param rec Record of the line
+ */
+static void declare_symbol(AssemblerContext *ctx, SymbolTable *symTab, const ParsedLine *rec) {
+    Symbol *s;
+
+    if (rec->symbol_type == SYMBOL_EXTERNAL) {
+        addSymbol(ctx, symTab, rec->symbol, 0, SYMBOL_EXTERNAL, rec->line_number);
+        return;
+    }
+
+    s = findSymbol(symTab, rec->symbol);
+    if (s) {
+        /* Check for conflict with external */
+        if (s->type == SYMBOL_EXTERNAL) {
+            fprintf(ctx->err, "Error at line %d: Symbol '%s' declared as .entry and .extern.\n", 
+                    rec->line_number, rec->symbol); 
+            ctx->has_error = 1;
+        } else {
+            markEntrySymbol(symTab, s);
+        }
+    } else {
+        /* Add as entry (will be resolved in second pass) */
+        addSymbol(ctx, symTab, rec->symbol, 0, SYMBOL_ENTRY, rec->line_number);
+    }
+}
+
+/**
+ * Applies a chunk's records to the symbol table and counters, exactly as a
+ * sequential scan of its lines would: labels are defined in source order and
+ * each line's diagnostics are printed where that scan would print them
+ * @param ctx The file's context
+ * @param symTab Pointer to the symbol table
+ * @param chunk The parsed chunk
+ * @param IC File instruction counter
+ * @param DC File data counter
+ * @param fixups Fixup table in one-pass mode, NULL otherwise
+ */
+static void merge_chunk(AssemblerContext *ctx, SymbolTable *symTab, const FirstPassChunk *chunk,
+                        int *IC, int *DC, FixupTable *fixups) {
+    const ParsedLine *rec;
+    long messages_start = 0;
+    int i;
+
+    for (i = 0; i < chunk->count; i++) {
+        rec = &chunk->lines_info[i];
+
+        if (rec->label) {
+            addSymbol(ctx, symTab, rec->label, rec->label_type == SYMBOL_DATA ? *DC : *IC, rec->label_type, rec->line_number);
+            /* Once an error is flagged, a labeled line is not processed further */
+            if (ctx->has_error) {
+                messages_start = rec->messages_end;
                 continue;
             }
+        }
 
-            /* Create instruction node */
-            newInst = malloc(sizeof(Instruction));
-            if (!newInst) { 
-                fprintf(stderr, "Memory allocation error.\n"); 
-                exit(1); 
-            }
-            
-            /* Initialize instruction */
-            newInst->address = IC;
-            newInst->original_line_number = lineNumber;
-            strncpy(newInst->opcode, command_or_directive, sizeof(newInst->opcode) - 1);
-            newInst->opcode[sizeof(newInst->opcode) - 1] = '\0';
-            newInst->num_operands = num_ops_found;
-            strncpy(newInst->operand1, op1_str, sizeof(newInst->operand1) - 1);
-            newInst->operand1[sizeof(newInst->operand1) - 1] = '\0';
-            strncpy(newInst->operand2, op2_str, sizeof(newInst->operand2) - 1);
-            newInst->operand2[sizeof(newInst->operand2) - 1] = '\0';
-
-            /* Initialize machine code fields (filled in second pass) */
-            newInst->num_operand_words = 0;
-            newInst->machine_code_base4[0] = '\0';
-            for(k=0; k<4; ++k) 
-                newInst->operand_words_base4[k][0] = '\0';
-
-            /* Calculate instruction length */
-            newInst->instruction_length = calculate_instruction_length(newInst->opcode, newInst->operand1, newInst->operand2);
-            if (newInst->instruction_length == -1) {
-                fprintf(stderr, "Error at line %d: Failed to determine instruction length for '%s'.\n", lineNumber, newInst->opcode);
-                g_has_error = 1;
-                free(newInst);
-                continue;
+        if (rec->messages_end > messages_start) {
+            fwrite(chunk->messages + messages_start, 1, (size_t)(rec->messages_end - messages_start), ctx->err);
+        }
+        messages_start = rec->messages_end;
+        if (rec->has_error) {
+            ctx->has_error = 1;
+        }
+
+        if (rec->symbol) {
+            declare_symbol(ctx, symTab, rec);
+        }
+        *DC += rec->data_count;
+        if (rec->inst) {
+            /* One-pass mode: encode now, deferring label words and encoding errors
+             * to the fixup table, which resolveFixups walks if parsing succeeds */
+            if (fixups) {
+                encode_instruction_words(ctx, rec->inst, symTab, fixups, rec->line_number);
             }
+            *IC += rec->inst->instruction_length;
+        }
+    }
+}
 
-            /* Add to instruction list (built in reverse) */
-            newInst->next = temp_i_head;
-            temp_i_head = newInst;
-            
-            /* Update instruction counter */
-            IC += newInst->instruction_length;
+/**
+ * Main first pass function - processes the entire input file
+ * Builds symbol table, validates syntax, creates the instruction list and data segment.
+ * The source is split at line boundaries into up to ctx->options->threads chunks
+ * that are parsed and sized in parallel; a prefix sum over the chunk totals gives
+ * each chunk its base addresses, and labels and messages are applied in source order
+ * @param ctx Assembly context (error flag and diagnostics stream)
+ * @param input Reader over the expanded source
+ * @param symTab Pointer to the symbol table
+ * @param instructionList Pointer to instruction list head
+ * @param data Empty data segment that receives the data words
+ * @param final_ic_out Output for final instruction counter
+ * @param final_dc_out Output for final data counter
+ * @param fixups Fixup table for one-pass mode, or NULL to leave encoding to secondPass
+ * @return 1 on success, 0 if errors occurred
+ */
+int firstPass(AssemblerContext *ctx, LineReader *input, SymbolTable *symTab, Instruction **instructionList, DataSegment *data, int *final_ic_out, int *final_dc_out, FixupTable *fixups) {
+    /* All variable declarations at top for C90 compliance */
+    FirstPassChunk *chunks;
+    int num_chunks;
+    int IC = MEMORY_START, DC = 0;  /* Instruction and Data counters */
+    int ic_base = MEMORY_START;
+    int dc_base, stored_base, run_base;
+    int line_base;
+    size_t start, end;
+    const char *newline;
+    Instruction *inst_tail = NULL;
+    int i;
+
+    /* Initialize the file's error flag */
+    ctx->has_error = 0;
+    *instructionList = NULL;
+
+    /* Every chunk gets at least MIN_FIRST_PASS_CHUNK_SIZE bytes */
+    num_chunks = ctx->options->threads;
+    if ((size_t)num_chunks > (input->size - input->pos) / MIN_FIRST_PASS_CHUNK_SIZE) {
+        num_chunks = (int)((input->size - input->pos) / MIN_FIRST_PASS_CHUNK_SIZE);
+    }
+    if (num_chunks < 1) {
+        num_chunks = 1;
+    }
+    chunks = (FirstPassChunk *)calloc((size_t)num_chunks, sizeof(FirstPassChunk));
+    if (!chunks) {
+        fprintf(stderr, "Memory allocation error for first pass chunks.\n");
+        exit(1); /* Critical error, terminate program */
+    }
+
+    /* Chunks end just after a '\n', so every chunk starts with a whole line */
+    start = input->pos;
+    for (i = 0; i < num_chunks; i++) {
+        end = input->size;
+        if (i < num_chunks - 1) {
+            end = start + (input->size - start) / (size_t)(num_chunks - i);
+            newline = (const char *)memchr(input->data + end, '\n', input->size - end);
+            end = newline ? (size_t)(newline - input->data) + 1 : input->size;
+        }
+        sliceLineReader(input, start, end, &chunks[i].lines);
+        chunks[i].ctx.options = ctx->options;
+        chunks[i].ctx.out = ctx->out;
+        initArena(&chunks[i].ctx.arena);
+        initDataSegment(&chunks[i].data);
+        start = end;
+    }
+
+    /* Line numbers of each chunk continue from the lines before it */
+    if (num_chunks > 1) {
+        runParallelTasks(num_chunks, num_chunks, count_chunk_lines, chunks);
+        line_base = input->line_number;
+        for (i = 0; i < num_chunks; i++) {
+            chunks[i].lines.line_number = line_base;
+            line_base += chunks[i].line_count;
+        }
+    }
+
+    /* The first chunk's data words are already at their final offsets */
+    chunks[0].data = *data;
+    runParallelTasks(num_chunks, num_chunks, parse_chunk, chunks);
+    *data = chunks[0].data;
+
+    /* Prefix sums of the chunk totals give each chunk its base addresses */
+    dc_base = data->count;
+    stored_base = data->stored;
+    run_base = data->num_runs;
+    for (i = 0; i < num_chunks; i++) {
+        chunks[i].ic_base = ic_base;
+        ic_base += chunks[i].ic;
+        if (i > 0) {
+            chunks[i].dc_base = dc_base;
+            dc_base += chunks[i].data.count;
+            stored_base += chunks[i].data.stored;
+            run_base += chunks[i].data.num_runs;
         }
     }
+    if (stored_base > data->stored) {
+        extend_data_segment(data, stored_base - data->stored);
+    }
+    if (run_base > data->num_runs) {
+        extend_zero_runs(data, run_base - data->num_runs);
+    }
+    data->count = dc_base;
+
+    /* Place each chunk's words and runs after those of the chunks before it */
+    stored_base = chunks[0].data.stored;
+    run_base = chunks[0].data.num_runs;
+    for (i = 1; i < num_chunks; i++) {
+        if (chunks[i].data.stored > 0) {
+            chunks[i].words_out = data->words + stored_base;
+        }
+        if (chunks[i].data.num_runs > 0) {
+            chunks[i].runs_out = data->runs + run_base;
+        }
+        stored_base += chunks[i].data.stored;
+        run_base += chunks[i].data.num_runs;
+    }
+    runParallelTasks(num_chunks, num_chunks, relocate_chunk, chunks);
 
-    /* Reverse instruction list to get correct order */
-    curr_i = temp_i_head;
-    while(curr_i) { 
-        next_i = curr_i->next; 
-        curr_i->next = prev_i; 
-        prev_i = curr_i; 
-        curr_i = next_i; 
+    /* Symbols, diagnostics and the final counters follow source order */
+    for (i = 0; i < num_chunks; i++) {
+        merge_chunk(ctx, symTab, &chunks[i], &IC, &DC, fixups);
     }
-    *instructionList = prev_i;
 
-    /* Reverse data list to get correct order */
-    curr_d = temp_d_head;
-    while(curr_d) { 
-        next_d = curr_d->next; 
-        curr_d->next = prev_d; 
-        prev_d = curr_d; 
-        curr_d = next_d; 
+    /* Join the instruction lists; their nodes become part of the file's arena */
+    for (i = 0; i < num_chunks; i++) {
+        if (chunks[i].inst_head) {
+            if (inst_tail) inst_tail->next = chunks[i].inst_head;
+            else *instructionList = chunks[i].inst_head;
+            inst_tail = chunks[i].inst_tail;
+        }
+        moveArena(&ctx->arena, &chunks[i].ctx.arena);
+        free(chunks[i].lines_info);
+        free(chunks[i].messages);
     }
-    *dataList = prev_d;
+    free(chunks);
 
     /* Set final counters */
     *final_ic_out = IC;
     *final_dc_out = DC;
     
     /* Update data symbol addresses (add IC to get final addresses) */
-    updateDataSymbolsAddresses(*symTab, IC);
+    updateDataSymbolsAddresses(symTab, IC);
 
     /* Return success/failure */
-    return !g_has_error;
-}
\ No newline at end of file
+    return !ctx->has_error;
+}
@@ -0,0 +1,265 @@
+/* lexer.c */
+/**
+ * @file lexer.c
+ * @brief Implements the table-driven source line lexer.
+ */
+
+#include "lexer.h"
+#include "opcodes.h" /* For findOpcode */
+#include <stdlib.h> /* For strtol */
+#include <string.h> /* For memchr, memcmp, memcpy, strlen */
+
+#define MAX_OPCODE_NAME_LENGTH 4 /* Longest mnemonic ("stop") */
+
+/* Shorthands for the table below */
+#define SP  (CHAR_SPACE | CHAR_WORD_END)        /* '\v', '\f' */
+#define BL  (SP | CHAR_OPERAND_END)             /* ' ', '\t' */
+#define EOL (SP | CHAR_LINE_END)                /* '\n', '\r' */
+#define NUL (CHAR_LINE_END | CHAR_WORD_END | CHAR_OPERAND_END)
+#define CM  CHAR_OPERAND_END                    /* ',' */
+#define DG  CHAR_DIGIT
+#define SG  CHAR_SIGN
+
+const unsigned char lexCharClass[256] = {
+    NUL, 0,   0,   0,   0,   0,   0,   0,   0,   BL,  EOL, SP,  SP,  EOL, 0,   0,   /* 0x00-0x0f */
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   /* 0x10-0x1f */
+    BL,  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   SG,  CM,  SG,  0,   0,   /* ' ' - '/' */
+    DG,  DG,  DG,  DG,  DG,  DG,  DG,  DG,  DG,  DG,  0,   0,   0,   0,   0,   0,   /* '0' - '?' */
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   /* '@' - 'O' */
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   /* 'P' - '_' */
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   /* '`' - 'o' */
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   /* 'p' - 0x7f */
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   /* 0x80-0xff */
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0
+};
+
+/**
+ * Reads a decimal integer with an optional sign, after optional whitespace
+ * @param p In: scan position; out: the character after the number
+ * @param end End of the text to scan (a token or the line)
+ * @param value Receives the number
+ * @return 1 on success, 0 if no digits follow
+ */
+static int lex_int(const char **p, const char *end, int *value) {
+    const char *start = *p;
+    const char *q;
+    char *digits_end;
+
+    while (start < end && CHAR_IS(*start, CHAR_SPACE)) start++;
+    q = start;
+    if (q < end && CHAR_IS(*q, CHAR_SIGN)) q++;
+    if (q >= end || !CHAR_IS(*q, CHAR_DIGIT)) return 0;
+    /* The text is followed by a non-digit delimiter, so strtol stops inside it */
+    *value = (int)strtol(start, &digits_end, 10);
+    *p = digits_end;
+    return 1;
+}
+
+/**
+ * Classifies an operand token by its text, in the order the addressing modes
+ * are resolved: '#' (immediate), register, '[' (matrix), number, symbol
+ * @param tok Token whose text and length are set
+ */
+static void classify_operand(Token *tok) {
+    const char *text = tok->text;
+    int i = 0;
+
+    if (text[0] == '#') {
+        const char *p = text + 1;
+
+        tok->type = TOKEN_IMMEDIATE;
+        if (!lex_int(&p, text + tok->length, &tok->value)) tok->value = 0;
+        return;
+    }
+    if (tok->length == 2 && text[0] == 'r' && text[1] >= '0' && text[1] <= '7') {
+        tok->type = TOKEN_REGISTER;
+        tok->value = text[1] - '0';
+        return;
+    }
+    if (memchr(text, '[', (size_t)tok->length)) {
+        tok->type = TOKEN_MATRIX;
+        return;
+    }
+
+    /* Optional sign followed by digits only */
+    if (CHAR_IS(text[0], CHAR_SIGN)) i++;
+    if (i < tok->length) {
+        while (i < tok->length && CHAR_IS(text[i], CHAR_DIGIT)) i++;
+        if (i == tok->length) {
+            tok->type = TOKEN_NUMBER;
+            tok->value = (int)strtol(text, NULL, 10); /* Stops at the delimiter after the token */
+            return;
+        }
+    }
+    tok->type = TOKEN_SYMBOL;
+}
+
+/**
+ * Matches a single character, after optional whitespace
+ * @param p In: scan position; out: the character after the match
+ * @param c Character to match
+ * @return 1 if it matched, 0 otherwise
+ */
+static int lex_char(const char **p, char c) {
+    const char *q = *p;
+
+    while (CHAR_IS(*q, CHAR_SPACE)) q++;
+    if (*q != c) return 0;
+    *p = q + 1;
+    return 1;
+}
+
+void initLexer(Lexer *lx, char *line) {
+    char *p = line;
+
+    while (!CHAR_IS(*p, CHAR_LINE_END)) p++;
+    *p = '\0';
+    lx->pos = line;
+}
+
+char lexSkipSpace(Lexer *lx) {
+    while (CHAR_IS(*lx->pos, CHAR_SPACE)) lx->pos++;
+    return *lx->pos;
+}
+
+int lexAtEnd(Lexer *lx) {
+    return lexSkipSpace(lx) == '\0';
+}
+
+int lexLabel(Lexer *lx, Token *tok) {
+    const char *p;
+
+    lexSkipSpace(lx);
+    for (p = lx->pos; *p != '\0' && *p != ':'; p++)
+        ;
+    if (*p != ':') return 0;
+
+    tok->type = TOKEN_LABEL;
+    tok->text = lx->pos;
+    tok->length = (int)(p - lx->pos);
+    tok->value = 0;
+    lx->pos = p + 1;
+    return 1;
+}
+
+int lexWord(Lexer *lx, Token *tok) {
+    const char *p;
+    char name[MAX_OPCODE_NAME_LENGTH + 1];
+    int opcode;
+
+    if (lexSkipSpace(lx) == '\0') return 0;
+    for (p = lx->pos; !CHAR_IS(*p, CHAR_WORD_END); p++)
+        ;
+
+    tok->text = lx->pos;
+    tok->length = (int)(p - lx->pos);
+    tok->value = 0;
+    tok->type = TOKEN_WORD;
+    lx->pos = p;
+
+    if (tok->text[0] == '.') {
+        tok->type = TOKEN_DIRECTIVE;
+    } else if (tok->length <= MAX_OPCODE_NAME_LENGTH) {
+        copyTokenText(tok, name);
+        opcode = findOpcode(name);
+        if (opcode >= 0) {
+            tok->type = TOKEN_OPCODE;
+            tok->value = opcode;
+        }
+    }
+    return 1;
+}
+
+int lexField(Lexer *lx, Token *tok) {
+    const char *p = lx->pos;
+
+    /* Runs of commas delimit a single field */
+    while (*p == ',') p++;
+    if (*p == '\0') {
+        lx->pos = p;
+        return 0;
+    }
+
+    while (CHAR_IS(*p, CHAR_SPACE)) p++;
+    tok->text = p;
+    while (!CHAR_IS(*p, CHAR_OPERAND_END)) p++;
+    tok->length = (int)(p - tok->text);
+    tok->value = 0;
+    if (tok->length == 0) {
+        tok->type = TOKEN_END;
+    } else {
+        classify_operand(tok);
+    }
+
+    /* The rest of the field is not part of the token */
+    while (*p != '\0' && *p != ',') p++;
+    if (*p == ',') p++;
+    lx->pos = p;
+    return 1;
+}
+
+int lexString(Lexer *lx, Token *tok) {
+    const char *p;
+    const char *closing = NULL;
+
+    if (lexSkipSpace(lx) != '"') return 0;
+    for (p = lx->pos + 1; *p != '\0'; p++) {
+        if (*p == '"') closing = p;
+    }
+
+    tok->type = TOKEN_STRING;
+    tok->text = lx->pos + 1;
+    if (closing) {
+        tok->length = (int)(closing - tok->text);
+        tok->value = 1;
+        lx->pos = closing + 1;
+    } else {
+        tok->length = (int)(p - tok->text);
+        tok->value = 0;
+        lx->pos = p;
+    }
+    return 1;
+}
+
+int lexMatrixDimensions(Lexer *lx, int *rows, int *cols) {
+    const char *p = lx->pos;
+    const char *end = lx->pos + strlen(lx->pos);
+
+    if (!lex_char(&p, '[') || !lex_int(&p, end, rows) || !lex_char(&p, ']') ||
+        !lex_char(&p, '[') || !lex_int(&p, end, cols) || !lex_char(&p, ']')) {
+        return 0;
+    }
+    lx->pos = p;
+    return 1;
+}
+
+int lexMatrixRegisters(const Token *tok, int *row, int *col) {
+    const char *p = tok->text;
+    const char *end = tok->text + tok->length;
+
+    /* Non-empty label */
+    while (p < end && *p != '[') p++;
+    if (p == tok->text || p == end) return 0;
+
+    if (end - p < 2 || p[0] != '[' || p[1] != 'r') return 0;
+    p += 2;
+    if (!lex_int(&p, end, row)) return 0;
+    if (end - p < 3 || p[0] != ']' || p[1] != '[' || p[2] != 'r') return 0;
+    p += 3;
+    return lex_int(&p, end, col);
+}
+
+int tokenEquals(const Token *tok, const char *s) {
+    return strlen(s) == (size_t)tok->length && memcmp(tok->text, s, (size_t)tok->length) == 0;
+}
+
+void copyTokenText(const Token *tok, char *buffer) {
+    memcpy(buffer, tok->text, (size_t)tok->length);
+    buffer[tok->length] = '\0';
+}
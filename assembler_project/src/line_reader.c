@@ -0,0 +1,214 @@
+/* line_reader.c */
+/**
+ * @file line_reader.c
+ * @brief Implements the in-memory source line iterator.
+ *
+ * Regular files are mapped read-only. If the file cannot be mapped (e.g. a
+ * pipe), it is read into a malloc'd buffer instead; readers of the lines
+ * cannot tell the difference.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "line_reader.h"
+#include <stdio.h>     /* For fprintf, stderr */
+#include <stdlib.h>    /* For malloc, realloc, free, exit */
+#include <string.h>    /* For memchr, memcpy */
+#include <fcntl.h>     /* For open */
+#include <unistd.h>    /* For read, close */
+#include <sys/mman.h>  /* For mmap, munmap */
+#include <sys/stat.h>  /* For fstat */
+
+#define READ_CHUNK_SIZE 65536 /* Growth step of the fallback buffer */
+
+/**
+ * @brief Reads the whole of an open file into a malloc'd buffer.
+ * @param reader The reader to fill.
+ * @param fd The open file.
+ * @return 1 on success, 0 on a read error.
+ */
+static int read_whole_file(LineReader *reader, int fd) {
+    char *buffer = NULL;
+    char *grown;
+    size_t capacity = 0;
+    size_t used = 0;
+    ssize_t count;
+
+    for (;;) {
+        if (used == capacity) {
+            capacity += READ_CHUNK_SIZE;
+            grown = (char *)realloc(buffer, capacity);
+            if (!grown) {
+                fprintf(stderr, "Memory allocation error for source file.\n");
+                exit(1); /* Critical error, terminate program */
+            }
+            buffer = grown;
+        }
+        count = read(fd, buffer + used, capacity - used);
+        if (count < 0) {
+            free(buffer);
+            return 0;
+        }
+        if (count == 0) break;
+        used += (size_t)count;
+    }
+
+    reader->data = buffer;
+    reader->size = used;
+    reader->mapped = 0;
+    return 1;
+}
+
+/**
+ * @brief Loads a file for line-by-line reading.
+ * @param reader The reader to initialize.
+ * @param path Path of the file.
+ * @return 1 on success, 0 if the file cannot be opened or read.
+ */
+int openLineReader(LineReader *reader, const char *path) {
+    struct stat info;
+    void *map;
+    int fd;
+    int ok = 1;
+
+    reader->data = NULL;
+    reader->size = 0;
+    reader->pos = 0;
+    reader->line_number = 0;
+    reader->mapped = 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        if (info.st_size == 0) {
+            close(fd);
+            return 1; /* Nothing to map */
+        }
+        map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            reader->data = (const char *)map;
+            reader->size = (size_t)info.st_size;
+            reader->mapped = 1;
+            close(fd); /* The mapping stays valid after closing */
+            return 1;
+        }
+    }
+
+    ok = read_whole_file(reader, fd);
+    close(fd);
+    return ok;
+}
+
+/**
+ * @brief Reads lines from text that is already in memory (e.g. expanded source).
+ * @param reader The reader to initialize.
+ * @param data A malloc'd buffer; the reader takes ownership and frees it on close.
+ * @param size Number of bytes in 'data'.
+ */
+void openLineReaderFromBuffer(LineReader *reader, char *data, size_t size) {
+    reader->data = data;
+    reader->size = size;
+    reader->pos = 0;
+    reader->line_number = 0;
+    reader->mapped = 0;
+}
+
+/**
+ * @brief Creates a reader over part of another reader's contents.
+ * @param reader The reader that owns the contents.
+ * @param start Offset of the first byte of the slice.
+ * @param end Offset just past the last byte of the slice.
+ * @param slice Receives the reader.
+ */
+void sliceLineReader(const LineReader *reader, size_t start, size_t end, LineReader *slice) {
+    slice->data = start < end ? reader->data + start : NULL;
+    slice->size = end - start;
+    slice->pos = 0;
+    slice->line_number = reader->line_number;
+    slice->mapped = reader->mapped;
+}
+
+/**
+ * @brief Returns the next line, split exactly where fgets with a buffer of
+ * max_length + 1 characters would split it.
+ * @param reader The reader.
+ * @param max_length Maximum number of characters per line (including the '\n').
+ * @param line Receives the view of the line.
+ * @return 1 if a line was returned, 0 at the end of the input.
+ */
+int readLine(LineReader *reader, size_t max_length, SourceLine *line) {
+    const char *start;
+    const char *newline;
+    size_t available;
+
+    if (reader->pos >= reader->size) {
+        return 0;
+    }
+
+    start = reader->data + reader->pos;
+    available = reader->size - reader->pos;
+    if (available > max_length) {
+        available = max_length;
+    }
+
+    newline = (const char *)memchr(start, '\n', available);
+    line->text = start;
+    line->length = newline ? (size_t)(newline - start) + 1 : available;
+    /* Like feof after fgets: only a short line without '\n' means the data ran out */
+    line->at_eof = !newline && line->length < max_length;
+    line->number = ++reader->line_number;
+
+    reader->pos += line->length;
+    return 1;
+}
+
+/**
+ * @brief Copies a line into a null-terminated buffer, exactly as fgets would have stored it.
+ * @param line The line to copy.
+ * @param buffer Destination of at least line->length + 1 characters.
+ */
+void copySourceLine(const SourceLine *line, char *buffer) {
+    memcpy(buffer, line->text, line->length);
+    buffer[line->length] = '\0';
+}
+
+/**
+ * @brief Skips the remainder of the current line, up to and including its '\n'.
+ * @param reader The reader.
+ */
+void skipRestOfLine(LineReader *reader) {
+    const char *newline;
+
+    if (reader->pos >= reader->size) {
+        return;
+    }
+    newline = (const char *)memchr(reader->data + reader->pos, '\n', reader->size - reader->pos);
+    reader->pos = newline ? (size_t)(newline - reader->data) + 1 : reader->size;
+}
+
+/**
+ * @brief Moves back to the first line; the contents are not read again.
+ * @param reader The reader.
+ */
+void rewindLineReader(LineReader *reader) {
+    reader->pos = 0;
+    reader->line_number = 0;
+}
+
+/**
+ * @brief Unmaps or frees the file contents.
+ * @param reader The reader to close.
+ */
+void closeLineReader(LineReader *reader) {
+    if (reader->mapped) {
+        munmap((void *)reader->data, reader->size);
+    } else {
+        free((void *)reader->data);
+    }
+    reader->data = NULL;
+    reader->size = 0;
+    reader->pos = 0;
+    reader->mapped = 0;
+}
@@ -3,279 +3,599 @@
  * @file macro_processor.c
  * @brief Implements the assembler's macro processing module.
  *
- * This module handles the pre-processing stage of assembly:
+ * This module handles the pre-processing stage of assembly in a single scan
+ * of the source:
  * 1. Reads and stores macro definitions from the source file
- * 2. Expands macro calls into their defined content
- * 3. Outputs an expanded file (.am) for the main assembler to process
+ * 2. Records how every other line appears in the output: unchanged, replaced
+ *    by a macro body, or (for a name not yet defined) a possible late call
+ * 3. A final sweep copies the source into the expanded text (.am contents),
+ *    resolving calls to macros that were defined further down the file. The
+ *    sweep works on ranges of the source: each range is measured, then written
+ *    at its offset in the output, so the ranges can be expanded in parallel
  * 
  * Macros allow code reuse by defining named blocks of assembly code
  * that can be inserted wherever the macro name appears.
+ *
+ * Macro structures are allocated from the file's arena and all macro bodies
+ * share one string pool, so building and freeing the whole macro set costs a
+ * handful of allocations regardless of how many macros or lines there are.
  */
 
-#define INITIAL_MACRO_LINES_CAPACITY 10  /* Starting size for macro line storage */
+#define INITIAL_MACRO_POOL_CAPACITY 4096  /* Starting size of the macro body pool; grows by doubling */
+#define INITIAL_EDIT_CAPACITY 64          /* Starting size of the source edit list; grows by doubling */
+#define MACRO_KEYWORD "mcro"              /* Also the start of "mcroend" */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include "macro_processor.h"
+#include "symbol_table.h" /* For hashSymbolName */
+#include "arena.h"
+#include "lexer.h"
+#include "thread_pool.h"
 #include "assembler.h"
 
+/**
+ * @brief How one source line differs from its copy in the expanded text.
+ * Lines without an edit are copied unchanged.
+ */
+typedef enum {
+    EDIT_REMOVE,     /* Part of a macro definition: not copied */
+    EDIT_TEXT,       /* Copied up to its first '\0' and ended with a newline */
+    EDIT_CALL,       /* A macro call: label prefix, macro body and a newline */
+    EDIT_CANDIDATE   /* Names no macro yet; resolved again if a macro is defined later */
+} SourceEditKind;
+
+/**
+ * @brief An edit of one source line (or of consecutive removed lines).
+ */
+typedef struct SourceEdit {
+    size_t offset;          /* Start of the edited span in the source */
+    size_t length;          /* Length of the span */
+    size_t text_length;     /* EDIT_TEXT/EDIT_CANDIDATE: characters before the first '\0' */
+    size_t prefix_length;   /* EDIT_CALL: length of the label kept before the body */
+    const Macro *macro;     /* EDIT_CALL: the called macro */
+    int macros_defined;     /* EDIT_CANDIDATE: number of macros defined when the line was read */
+    SourceEditKind kind;
+} SourceEdit;
+
+/**
+ * @brief The edits of a source file, in source order.
+ */
+typedef struct SourceEdits {
+    SourceEdit *items;
+    int count;
+    int capacity;
+} SourceEdits;
+
+/**
+ * @brief A range of the source expanded by one worker of the final sweep.
+ */
+typedef struct ExpansionChunk {
+    const LineReader *input;    /* The source */
+    const MacroTable *table;    /* All defined macros */
+    SourceEdit *edits;          /* Edits inside the range, in source order */
+    int count;                  /* Number of edits */
+    size_t start;               /* Source offset of the range */
+    size_t end;                 /* Source offset just past the range */
+    size_t size;                /* Length of the range's expansion */
+    char *output;               /* Where the expansion is written */
+} ExpansionChunk;
+
 /* --- Internal Helper Functions Prototypes --- */
-Macro* processMacroDefinitions(FILE* input);
-char* expandMacroInLine(const char* line, Macro* macroList);
-void freeMacroList(Macro* head);
-static char* skip_whitespace_macro(char* s);
 static int is_reserved_macro_name(const char* name);
 
 /**
- * Main entry point for macro processing stage
- * This is called before the two-pass assembly begins
- * 
- * Process:
- * 1. First pass through file: collect all macro definitions
- * 2. Second pass through file: expand macro calls and write output
+ * Checks if a name is reserved and cannot be used as a macro name
+ * Prevents conflicts with assembly instructions and directives
  * 
- * @param input  Input file stream (.as file with possible macros)
- * @param output Output file stream (.am file with macros expanded)
- * @return 1 on success, 0 on failure
+ * @param name The proposed macro name
+ * @return 1 if reserved (cannot use), 0 if available
  */
-int create_expanded_file(FILE* input, FILE* output) {
-    char line[MAX_LINE_LENGTH + 2];  /* Buffer for reading lines */
-    int in_macro_def_for_skipping = 0;  /* Flag: currently inside macro definition */
-    Macro* macroList;  /* Linked list of all macro definitions */
-    char* trimmed_line;
-    char first_word[MAX_SYMBOL_LENGTH] = {0};
-    char *expanded;
-
-    /* Step 1: First pass - collect all macro definitions */
-    macroList = processMacroDefinitions(input);
-    if (g_has_error) {
-        /* Error occurred during macro processing */
-        freeMacroList(macroList);
-        return 0;
+static int is_reserved_macro_name(const char* name) {
+    /* Check if it's an opcode (mov, add, etc.) */
+    if (is_opcode(name) || is_register(name)) return 1;
+    
+    /* Check if it's a directive or macro keyword */
+    if (strcmp(name, ".data") == 0 || strcmp(name, ".string") == 0 ||
+        strcmp(name, ".mat") == 0 || strcmp(name, ".extern") == 0 ||
+        strcmp(name, ".entry") == 0 || strcmp(name, "mcro") == 0 ||
+        strcmp(name, "mcroend") == 0) {
+        return 1;
     }
+    return 0;
+}
 
-    /* Step 2: Reset file to beginning for second pass */
-    rewind(input);
+/* --- Macro Table --- */
 
-    /* Step 3: Second pass - expand macros and write output */
-    while (fgets(line, sizeof(line), input)) {
-        trimmed_line = skip_whitespace_macro(line);
+/**
+ * Finds the slot holding 'name', or the empty slot where it would be inserted
+ * @param table Macro table (capacity must be non-zero)
+ * @param name  The name to look for
+ * @param hash  The precomputed hash of 'name'
+ * @return Index of the matching or first empty slot
+ */
+static int probe_macro_slot(const MacroTable *table, const char *name, unsigned long hash) {
+    int mask = table->capacity - 1;
+    int i = (int)(hash & (unsigned long)mask);
+    Macro *candidate;
+
+    while ((candidate = table->slots[i]) != NULL) {
+        if (candidate->hash == hash && strcmp(candidate->name, name) == 0) {
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
 
-        /* Check if we're entering or leaving a macro definition */
-        /* We skip these in the output since macros are being expanded */
-        if (sscanf(trimmed_line, "%s", first_word) == 1) {
-            if (strcmp(first_word, "mcro") == 0) {
-                /* Start of macro definition - skip it */
-                in_macro_def_for_skipping = 1;
-                continue;
-            }
-            if (strcmp(first_word, "mcroend") == 0) {
-                /* End of macro definition - stop skipping */
-                in_macro_def_for_skipping = 0;
-                continue;
-            }
+/**
+ * Doubles the hash index and reinserts every macro using its cached hash
+ * @param table Macro table
+ */
+static void grow_macro_index(MacroTable *table) {
+    Macro **old_slots = table->slots;
+    int old_capacity = table->capacity;
+    int i;
+
+    table->capacity = old_capacity ? old_capacity * 2 : INITIAL_MACRO_TABLE_CAPACITY;
+    table->slots = (Macro **)calloc((size_t)table->capacity, sizeof(Macro *));
+    if (!table->slots) {
+        fprintf(stderr, "Memory allocation error for macro table index.\n");
+        exit(1); /* Critical error, terminate program */
+    }
+
+    for (i = 0; i < old_capacity; i++) {
+        if (old_slots[i]) {
+            table->slots[probe_macro_slot(table, old_slots[i]->name, old_slots[i]->hash)] = old_slots[i];
         }
-        
-        /* Skip lines inside macro definitions */
-        if (in_macro_def_for_skipping) continue;
+    }
+    free(old_slots);
+}
 
-        /* Try to expand any macro calls in this line */
-        expanded = expandMacroInLine(line, macroList);
+/**
+ * Initializes an empty macro table
+ * @param table Macro table to initialize
+ */
+void initMacroTable(MacroTable *table) {
+    table->head = NULL;
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+    table->pool = NULL;
+    table->pool_length = 0;
+    table->pool_capacity = 0;
+}
 
-        /* Write the result (either expanded or original) to output */
-        fprintf(output, "%s", expanded);
-        
-        /* Ensure line ends with newline */
-        if (expanded[strlen(expanded)-1] != '\n') {
-            fprintf(output, "\n");
+/**
+ * Searches for a macro by name
+ * @param table Macro table
+ * @param name  Name of the macro
+ * @return The macro, or NULL if no macro has that name
+ */
+Macro* findMacro(const MacroTable *table, const char *name) {
+    if (table->count == 0) {
+        return NULL;
+    }
+    return table->slots[probe_macro_slot(table, name, hashSymbolName(name))];
+}
+
+/**
+ * Adds a macro to the list and the hash index (its name must be new)
+ * @param table Macro table
+ * @param macro The macro to add; its name must already be set
+ */
+static void insert_macro(MacroTable *table, Macro *macro) {
+    /* Keep the index at most half full so probe sequences stay short */
+    if ((table->count + 1) * 2 > table->capacity) {
+        grow_macro_index(table);
+    }
+    macro->hash = hashSymbolName(macro->name);
+    macro->next = table->head;
+    table->head = macro;
+    table->slots[probe_macro_slot(table, macro->name, macro->hash)] = macro;
+    table->count++;
+}
+
+/**
+ * Returns the body of a macro
+ * @param table Macro table holding the macro
+ * @param macro The macro
+ * @return Its content lines separated by '\n' (macro->body_length characters, not null-terminated)
+ */
+const char* getMacroBody(const MacroTable *table, const Macro *macro) {
+    return table->pool + macro->body_offset;
+}
+
+/**
+ * Appends one content line to the body of the macro being defined
+ * Definitions cannot nest, so that body always ends at the end of the pool
+ * @param table  Macro table
+ * @param macro  Macro being defined (the most recently added one)
+ * @param text   The line (without its newline)
+ * @param length Number of characters in 'text'
+ */
+static void append_macro_line(MacroTable *table, Macro *macro, const char *text, size_t length) {
+    size_t needed = table->pool_length + length + 1; /* +1 for the separator */
+    size_t new_capacity;
+    char *grown;
+
+    if (needed > table->pool_capacity) {
+        new_capacity = table->pool_capacity ? table->pool_capacity : INITIAL_MACRO_POOL_CAPACITY;
+        while (needed > new_capacity) {
+            new_capacity *= 2;  /* Double capacity */
+        }
+        grown = (char *)realloc(table->pool, new_capacity);
+        if (!grown) {
+            fprintf(stderr, "Memory allocation error for macro bodies.\n");
+            exit(1); /* Critical error, terminate program */
         }
+        table->pool = grown;
+        table->pool_capacity = new_capacity;
+    }
+
+    /* Lines of one body are separated by '\n' */
+    if (macro->lineCount > 0) {
+        table->pool[table->pool_length++] = '\n';
+    }
+    memcpy(table->pool + table->pool_length, text, length);
+    table->pool_length += length;
+    macro->body_length = table->pool_length - macro->body_offset;
+    macro->lineCount++;
+}
 
-        /* Free memory only if expansion created a new string */
-        if (expanded != line) {
-            free(expanded);
+/* --- Expanded Text and Source Edits --- */
+
+/**
+ * Appends a new, uninitialized edit to the edit list
+ * @param edits The edit list
+ * @return The new edit
+ */
+static SourceEdit* add_edit(SourceEdits *edits) {
+    SourceEdit *grown;
+
+    if (edits->count == edits->capacity) {
+        edits->capacity = edits->capacity ? edits->capacity * 2 : INITIAL_EDIT_CAPACITY;
+        grown = (SourceEdit *)realloc(edits->items, (size_t)edits->capacity * sizeof(SourceEdit));
+        if (!grown) {
+            fprintf(stderr, "Memory allocation error for macro expansion.\n");
+            exit(1); /* Critical error, terminate program */
         }
+        edits->items = grown;
     }
+    return &edits->items[edits->count++];
+}
 
-    /* Step 4: Clean up all macro definitions */
-    freeMacroList(macroList);
-    return 1;
+/**
+ * Marks a line of a macro definition as removed from the expanded text
+ * Consecutive removed lines share one edit
+ * @param edits The edit list
+ * @param input Reader over the source
+ * @param line  The removed line
+ */
+static void remove_line(SourceEdits *edits, const LineReader *input, const SourceLine *line) {
+    size_t offset = (size_t)(line->text - input->data);
+    SourceEdit *last = edits->count ? &edits->items[edits->count - 1] : NULL;
+    SourceEdit *edit;
+
+    if (last && last->kind == EDIT_REMOVE && last->offset + last->length == offset) {
+        last->length += line->length;
+        return;
+    }
+    edit = add_edit(edits);
+    edit->kind = EDIT_REMOVE;
+    edit->offset = offset;
+    edit->length = line->length;
 }
 
 /**
- * Utility function to skip whitespace at beginning of string
- * Used throughout macro processing for parsing
- * 
- * @param s Input string pointer
- * @return Pointer to first non-whitespace character
+ * Records an ordinary line, which is copied up to its first '\0' and always
+ * ended with a newline. Most lines are copied unchanged and need no edit.
+ * @param edits       The edit list
+ * @param input       Reader over the source
+ * @param line        The line
+ * @param text_length Number of characters before its first '\0'
  */
-char* skip_whitespace_macro(char* s) {
-    while (s && isspace((unsigned char)*s)) {
-        s++;
+static void keep_line(SourceEdits *edits, const LineReader *input, const SourceLine *line, size_t text_length) {
+    SourceEdit *edit;
+
+    if (text_length == line->length && line->text[line->length - 1] == '\n') {
+        return; /* Copied as it is */
     }
-    return s;
+    edit = add_edit(edits);
+    edit->kind = EDIT_TEXT;
+    edit->offset = (size_t)(line->text - input->data);
+    edit->length = line->length;
+    edit->text_length = text_length;
 }
 
 /**
- * Checks if a name is reserved and cannot be used as a macro name
- * Prevents conflicts with assembly instructions and directives
+ * Returns the length of a kept line (see keep_line) in the expanded text
+ * @param text        The line
+ * @param text_length Number of characters before its first '\0'
+ * @return Number of characters emit_line writes
+ */
+static size_t line_size(const char *text, size_t text_length) {
+    return text_length + (text_length > 0 && text[text_length - 1] != '\n');
+}
+
+/**
+ * Writes a kept line (see keep_line) to the expanded text
+ * @param out         Where to write
+ * @param text        The line
+ * @param text_length Number of characters before its first '\0'
+ * @return The position after the written characters
+ */
+static char* emit_line(char *out, const char *text, size_t text_length) {
+    memcpy(out, text, text_length);
+    out += text_length;
+    if (text_length > 0 && text[text_length - 1] != '\n') {
+        *out++ = '\n';
+    }
+    return out;
+}
+
+/**
+ * Returns the length of the expansion of a macro call
+ * @param prefix_length Length of the label part of the line to keep
+ * @param macro         The called macro
+ * @return Number of characters emit_call writes
+ */
+static size_t call_size(size_t prefix_length, const Macro *macro) {
+    return macro->body_length == 0 ? 0 : prefix_length + macro->body_length + 1;
+}
+
+/**
+ * Writes the expansion of a macro call: the label prefix of the line, the
+ * macro body and a newline. A macro with an empty body expands to nothing.
+ * @param out           Where to write
+ * @param table         Macro table
+ * @param text          The calling line
+ * @param prefix_length Length of the label part of the line to keep
+ * @param macro         The called macro
+ * @return The position after the written characters
+ */
+static char* emit_call(char *out, const MacroTable *table, const char *text, size_t prefix_length, const Macro *macro) {
+    if (macro->body_length == 0) return out;
+    memcpy(out, text, prefix_length);
+    out += prefix_length;
+    memcpy(out, getMacroBody(table, macro), macro->body_length);
+    out += macro->body_length;
+    *out++ = '\n';
+    return out;
+}
+
+/**
+ * Checks whether the source mentions the macro keyword at all
+ * ("mcroend" contains it too); if not, no line can define or call a macro
+ * @param data Source text
+ * @param size Number of characters in 'data'
+ * @return 1 if "mcro" occurs anywhere in the source, 0 otherwise
+ */
+static int contains_macro_keyword(const char *data, size_t size) {
+    size_t keyword_length = strlen(MACRO_KEYWORD);
+    const char *p = data;
+    const char *end = data + size;
+
+    while (p && (size_t)(end - p) >= keyword_length) {
+        if (memcmp(p, MACRO_KEYWORD, keyword_length) == 0) {
+            return 1;
+        }
+        p = (const char *)memchr(p + 1, MACRO_KEYWORD[0], (size_t)(end - p - 1));
+    }
+    return 0;
+}
+
+/**
+ * Finds the name a line would call if it were a macro call
+ * Handles labels that may appear before macro calls (e.g., "LABEL: macro_name")
  * 
- * @param name The proposed macro name
- * @return 1 if reserved (cannot use), 0 if available
+ * @param line          The line to check
+ * @param name          Receives the first word after the label (at most MAX_SYMBOL_LENGTH - 1 characters)
+ * @param prefix_length Receives the length of the label part to keep (0 if there is no label)
+ * @return 1 if the line has such a word, 0 for empty, comment and label-only lines
  */
-int is_reserved_macro_name(const char* name) {
-    /* Check if it's an opcode (mov, add, etc.) */
-    if (is_opcode(name) || is_register(name)) return 1;
+static int extract_call_name(const char* line, char *name, size_t *prefix_length) {
+    char line_copy[MAX_LINE_LENGTH + 2];
+    Lexer lx;
+    Token label;
+    Token word;
+    int has_label;
     
-    /* Check if it's a directive or macro keyword */
-    if (strcmp(name, ".data") == 0 || strcmp(name, ".string") == 0 ||
-        strcmp(name, ".mat") == 0 || strcmp(name, ".extern") == 0 ||
-        strcmp(name, ".entry") == 0 || strcmp(name, "mcro") == 0 ||
-        strcmp(name, "mcroend") == 0) {
-        return 1;
+    /* Work with a copy to avoid modifying original */
+    strcpy(line_copy, line);
+    initLexer(&lx, line_copy);
+    
+    /* Skip empty lines and comments */
+    if (lexSkipSpace(&lx) == '\0' || *lx.pos == ';') return 0;
+    
+    /* Line has a label - macro name would be after the colon */
+    has_label = lexLabel(&lx, &label);
+    
+    /* Extract the potential macro name (first word after label if present) */
+    if (!lexWord(&lx, &word)) return 0;
+    if (word.length > MAX_SYMBOL_LENGTH - 1) word.length = MAX_SYMBOL_LENGTH - 1;
+    copyTokenText(&word, name);
+
+    /* A label is kept in front of the first macro line */
+    *prefix_length = has_label ? (size_t)(word.text - line_copy) : 0;
+    return 1;
+}
+
+/**
+ * Records an ordinary (non-definition) line: a call of a known macro, a
+ * possible call of a macro defined further down, or a line copied as it is
+ * @param edits       The edit list
+ * @param input       Reader over the source
+ * @param table       Macros defined so far
+ * @param line        The line as read
+ * @param text        The line up to its first '\0'
+ * @param text_length Number of characters in 'text'
+ */
+static void record_line(SourceEdits *edits, const LineReader *input, const MacroTable *table,
+                        const SourceLine *line, const char *text, size_t text_length) {
+    char name[MAX_SYMBOL_LENGTH];
+    size_t prefix_length;
+    const Macro *macro;
+    SourceEdit *edit;
+
+    if (extract_call_name(text, name, &prefix_length)) {
+        macro = findMacro(table, name);
+        /* Names that can never be macros (e.g. opcodes) need not be looked up again */
+        if (macro || (is_valid_label(name) && !is_reserved_macro_name(name))) {
+            edit = add_edit(edits);
+            edit->offset = (size_t)(line->text - input->data);
+            edit->length = line->length;
+            edit->text_length = text_length;
+            edit->prefix_length = prefix_length;
+            edit->macro = macro;
+            edit->macros_defined = table->count;
+            edit->kind = macro ? EDIT_CALL : EDIT_CANDIDATE;
+            return;
+        }
     }
-    return 0;
+    keep_line(edits, input, line, text_length);
 }
 
 /**
- * First pass: Reads entire file and collects all macro definitions
- * Builds a linked list of Macro structures containing macro names and content
+ * Scans the source once: collects all macro definitions and records the edits
+ * that turn the source into the expanded text
  * 
  * Macro syntax:
  *   mcro MACRO_NAME
  *   ... macro content ...
  *   mcroend
  * 
- * @param input The input file to scan for macros
- * @return Head of linked list containing all macro definitions
+ * @param ctx        Assembly context (error flag and diagnostics stream)
+ * @param input      Reader over the input file
+ * @param table      Macro table that receives all macro definitions
+ * @param edits      Edit list that receives the edits, in source order
+ * @param has_macros 0 if the source never mentions the macro keyword; lines are then only length-checked
  */
-Macro* processMacroDefinitions(FILE* input) {
-    Macro* macroList = NULL;  /* Head of macro list */
+static void scan_source(AssemblerContext *ctx, LineReader* input, MacroTable *table, SourceEdits *edits, int has_macros) {
     char line[MAX_LINE_LENGTH + 2];
+    SourceLine source_line;
     int inMacro = 0;  /* Flag: currently inside a macro definition */
     Macro *currentMacro = NULL;  /* Macro being built */
     int lineNumber = 0;
-    int c;
-    char *macro_name_pos;
-    char macro_name[MAX_SYMBOL_LENGTH];
-    char *remaining;
-    Macro *temp_iter;
-    char **new_lines;  /* For reallocation when macro grows */
+    Lexer lx;
+    Token command;
+    Token name;
+    char macro_name[MAX_LINE_LENGTH + 2];  /* No word is longer than a line */
     size_t line_len;
-    char *trimmed_line;
-    char command_token[MAX_SYMBOL_LENGTH];
-    int read_count;
-    int name_read_count;
 
     /* Process file line by line */
-    while (fgets(line, sizeof(line), input)) {
-        lineNumber++;
+    while (readLine(input, sizeof(line) - 1, &source_line)) {
+        copySourceLine(&source_line, line);
+        lineNumber = source_line.number;
         
         /* Check for line length overflow */
         line_len = strlen(line);
-        if (line_len > 0 && line[line_len - 1] != '\n' && !feof(input)) {
-            fprintf(stderr, "Error at line %d: Line exceeds maximum length.\n", lineNumber);
-            g_has_error = 1;
+        if (line_len > 0 && line[line_len - 1] != '\n' && !source_line.at_eof) {
+            fprintf(ctx->err, "Error at line %d: Line exceeds maximum length.\n", lineNumber);
+            ctx->has_error = 1;
             /* Skip rest of oversized line */
-            while ((c = fgetc(input)) != '\n' && c != EOF);
+            skipRestOfLine(input);
+            continue;
+        }
+
+        /* Without the macro keyword no line can define or call a macro */
+        if (!has_macros) {
+            keep_line(edits, input, &source_line, line_len);
             continue;
         }
 
         /* Remove newline characters */
-        line[strcspn(line, "\r\n")] = '\0';
-        trimmed_line = skip_whitespace_macro(line);
+        initLexer(&lx, line);
 
-        /* Skip empty lines and comments */
-        if (*trimmed_line == '\0' || *trimmed_line == ';') continue;
+        /* Skip empty lines and comments (kept in the output unless inside a definition) */
+        if (lexSkipSpace(&lx) == '\0' || *lx.pos == ';') {
+            if (inMacro) {
+                remove_line(edits, input, &source_line);
+            } else {
+                keep_line(edits, input, &source_line, line_len);
+            }
+            continue;
+        }
 
         /* Parse first word of line */
-        if (sscanf(trimmed_line, "%s%n", command_token, &read_count) != 1) continue;
+        if (!lexWord(&lx, &command)) {
+            keep_line(edits, input, &source_line, line_len);
+            continue;
+        }
 
         /* Check for macro definition start */
-        if (strcmp(command_token, "mcro") == 0) {
+        if (tokenEquals(&command, MACRO_KEYWORD)) {
+            remove_line(edits, input, &source_line);
+
             /* Validate we're not already in a macro (no nesting allowed) */
             if (inMacro) {
-                fprintf(stderr, "Error at line %d: Nested macro definitions are not allowed.\n", lineNumber);
-                g_has_error = 1;
+                fprintf(ctx->err, "Error at line %d: Nested macro definitions are not allowed.\n", lineNumber);
+                ctx->has_error = 1;
                 continue;
             }
             inMacro = 1;
             
             /* Extract macro name */
-            macro_name_pos = skip_whitespace_macro(trimmed_line + read_count);
-
-            if (sscanf(macro_name_pos, "%s%n", macro_name, &name_read_count) != 1) {
-                fprintf(stderr, "Error at line %d: Macro definition missing name.\n", lineNumber);
-                g_has_error = 1;
+            if (!lexWord(&lx, &name)) {
+                fprintf(ctx->err, "Error at line %d: Macro definition missing name.\n", lineNumber);
+                ctx->has_error = 1;
                 inMacro = 0; 
                 continue;
             }
 
             /* Check for extra text after macro name */
-            remaining = skip_whitespace_macro(macro_name_pos + name_read_count);
-            if (*remaining != '\0') {
-                fprintf(stderr, "Error at line %d: Extraneous text after macro name.\n", lineNumber);
-                g_has_error = 1;
+            if (!lexAtEnd(&lx)) {
+                fprintf(ctx->err, "Error at line %d: Extraneous text after macro name.\n", lineNumber);
+                ctx->has_error = 1;
                 inMacro = 0; 
                 continue;
             }
 
             /* Validate macro name */
+            copyTokenText(&name, macro_name);
             if (!is_valid_label(macro_name) || is_reserved_macro_name(macro_name)) {
-                fprintf(stderr, "Error at line %d: Invalid or reserved macro name '%s'.\n", lineNumber, macro_name);
-                g_has_error = 1;
+                fprintf(ctx->err, "Error at line %d: Invalid or reserved macro name '%s'.\n", lineNumber, macro_name);
+                ctx->has_error = 1;
                 inMacro = 0; 
                 continue;
             }
 
             /* Check for duplicate macro names */
-            temp_iter = macroList;
-            while(temp_iter){
-                if(strcmp(temp_iter->name, macro_name) == 0){
-                    fprintf(stderr, "Error at line %d: Macro '%s' already defined.\n", lineNumber, macro_name);
-                    g_has_error = 1; 
-                    break;
-                }
-                temp_iter = temp_iter->next;
+            if (findMacro(table, macro_name)) {
+                fprintf(ctx->err, "Error at line %d: Macro '%s' already defined.\n", lineNumber, macro_name);
+                ctx->has_error = 1;
             }
-            if(g_has_error) { 
+            if(ctx->has_error) { 
                 inMacro = 0; 
                 continue; 
             }
 
             /* Create new macro structure */
-            currentMacro = (Macro*)malloc(sizeof(Macro));
-            if (!currentMacro) exit(1);
+            currentMacro = (Macro*)arenaAlloc(&ctx->arena, sizeof(Macro));
 
             /* Initialize macro */
             strncpy(currentMacro->name, macro_name, MAX_SYMBOL_LENGTH -1);
             currentMacro->name[MAX_SYMBOL_LENGTH - 1] = '\0';
             currentMacro->lineCount = 0;
-            currentMacro->capacity = INITIAL_MACRO_LINES_CAPACITY;
-            
-            /* Allocate initial line storage */
-            currentMacro->lines = malloc(currentMacro->capacity * sizeof(char*));
-            if (!currentMacro->lines) { 
-                free(currentMacro); 
-                exit(1); 
-            }
+            currentMacro->body_offset = table->pool_length;
+            currentMacro->body_length = 0;
 
-            /* Add to macro list */
-            currentMacro->next = macroList;
-            macroList = currentMacro;
+            /* Add to macro table */
+            insert_macro(table, currentMacro);
 
-        } else if (strcmp(command_token, "mcroend") == 0) {
+        } else if (tokenEquals(&command, "mcroend")) {
+            remove_line(edits, input, &source_line);
             /* End of macro definition */
             if (!inMacro) {
-                fprintf(stderr, "Error at line %d: 'mcroend' without 'mcro'.\n", lineNumber);
-                g_has_error = 1; 
+                fprintf(ctx->err, "Error at line %d: 'mcroend' without 'mcro'.\n", lineNumber);
+                ctx->has_error = 1; 
                 continue;
             }
             
             /* Check for extra text after mcroend */
-            if (skip_whitespace_macro(trimmed_line + read_count)[0] != '\0') {
-                fprintf(stderr, "Error at line %d: Extraneous text after 'mcroend'.\n", lineNumber);
-                g_has_error = 1;
+            if (!lexAtEnd(&lx)) {
+                fprintf(ctx->err, "Error at line %d: Extraneous text after 'mcroend'.\n", lineNumber);
+                ctx->has_error = 1;
             }
             
             /* Close current macro definition */
@@ -284,173 +604,261 @@ Macro* processMacroDefinitions(FILE* input) {
 
         } else if (inMacro) {
             /* Inside macro definition - store this line */
+            remove_line(edits, input, &source_line);
             if (!currentMacro) { 
-                g_has_error = 1; 
+                ctx->has_error = 1; 
                 inMacro = 0; 
                 continue; 
             }
             
-            /* Expand storage if needed (dynamic array growth) */
-            if (currentMacro->lineCount >= currentMacro->capacity) {
-                currentMacro->capacity *= 2;  /* Double capacity */
-                new_lines = realloc(currentMacro->lines, currentMacro->capacity * sizeof(char*));
-                if (!new_lines) exit(1);
-                currentMacro->lines = new_lines;
-            }
-            
             /* Store complete line including original indentation */
-            /* Using malloc+strcpy instead of strdup for ANSI C compliance */
-            currentMacro->lines[currentMacro->lineCount] = malloc(strlen(line) + 1);
-            if (!currentMacro->lines[currentMacro->lineCount]) exit(1);
-            strcpy(currentMacro->lines[currentMacro->lineCount], line);
-            currentMacro->lineCount++;
+            append_macro_line(table, currentMacro, line, strlen(line));
+        } else {
+            /* Any other line is a macro call or copied as it is */
+            record_line(edits, input, table, &source_line, line, line_len);
         }
     }
 
     /* Check for unclosed macro definition */
     if (inMacro) {
-        fprintf(stderr, "Error: Macro definition started but never ended with 'mcroend'.\n");
-        g_has_error = 1;
+        fprintf(ctx->err, "Error: Macro definition started but never ended with 'mcroend'.\n");
+        ctx->has_error = 1;
     }
+}
+
+
+/**
+ * First step of the final sweep over a range: resolves the lines that named no
+ * macro when they were read (looked up again only if a macro was defined after
+ * them) and measures the expansion of the range
+ * @param chunks_ptr The ExpansionChunk array
+ * @param index      Index of the range
+ */
+static void measure_chunk(void *chunks_ptr, int index) {
+    ExpansionChunk *chunk = (ExpansionChunk *)chunks_ptr + index;
+    char line[MAX_LINE_LENGTH + 2];
+    char name[MAX_SYMBOL_LENGTH];
+    size_t prefix_length;
+    const Macro *macro;
+    SourceEdit *edit;
+    const char *text;
+    size_t pos = chunk->start;
+    size_t size = 0;
+    int i;
+
+    for (i = 0; i < chunk->count; i++) {
+        edit = &chunk->edits[i];
+        text = chunk->input->data + edit->offset;
+
+        /* Unedited lines in between are copied as they are */
+        size += edit->offset - pos;
+        pos = edit->offset + edit->length;
+
+        if (edit->kind == EDIT_CANDIDATE) {
+            edit->kind = EDIT_TEXT;
+            if (edit->macros_defined < chunk->table->count) {
+                memcpy(line, text, edit->length);
+                line[edit->length] = '\0';
+                if (extract_call_name(line, name, &prefix_length) && (macro = findMacro(chunk->table, name)) != NULL) {
+                    edit->kind = EDIT_CALL;
+                    edit->prefix_length = prefix_length;
+                    edit->macro = macro;
+                }
+            }
+        }
 
-    return macroList;
+        switch (edit->kind) {
+        case EDIT_CALL:
+            size += call_size(edit->prefix_length, edit->macro);
+            break;
+        case EDIT_TEXT:
+            size += line_size(text, edit->text_length);
+            break;
+        default: /* EDIT_REMOVE */
+            break;
+        }
+    }
+    chunk->size = size + (chunk->end - pos);
 }
 
 /**
- * Expands macro calls in a single line
- * Handles labels that may appear before macro calls (e.g., "LABEL: macro_name")
- * 
- * @param line The line to check for macro expansion
- * @param macroList List of all defined macros
- * @return Pointer to expanded string (newly allocated) or original line if no macro
+ * Second step of the final sweep over a range: writes its expansion
+ * @param chunks_ptr The ExpansionChunk array (measured)
+ * @param index      Index of the range
  */
-char* expandMacroInLine(const char* line, Macro* macroList) {
-    char line_copy[MAX_LINE_LENGTH + 2];
-    char *trimmed;
-    char *colon;
-    char macro_name[MAX_SYMBOL_LENGTH];
-    char *macro_start;
-    Macro *iter;
-    int leading_spaces;
-    int i, j;
-    char *result;
-    size_t total_size;
-    size_t prefix_len;
-    
-    if (!line) return (char*)line;
-    
-    /* Work with a copy to avoid modifying original */
-    strcpy(line_copy, line);
-    
-    /* Remove newline for processing */
-    line_copy[strcspn(line_copy, "\r\n")] = '\0';
-    
-    trimmed = skip_whitespace_macro(line_copy);
-    
-    /* Skip empty lines and comments */
-    if (*trimmed == '\0' || *trimmed == ';') return (char*)line;
-    
-    /* Check for label (indicated by colon) */
-    colon = strchr(trimmed, ':');
-    macro_start = trimmed;
-    
-    if (colon) {
-        /* Line has a label - macro name would be after the colon */
-        macro_start = skip_whitespace_macro(colon + 1);
-        if (*macro_start == '\0') return (char*)line;
+static void write_chunk(void *chunks_ptr, int index) {
+    ExpansionChunk *chunk = (ExpansionChunk *)chunks_ptr + index;
+    const SourceEdit *edit;
+    const char *text;
+    char *out = chunk->output;
+    size_t pos = chunk->start;
+    int i;
+
+    for (i = 0; i < chunk->count; i++) {
+        edit = &chunk->edits[i];
+        text = chunk->input->data + edit->offset;
+
+        /* Unedited lines in between are copied in one span */
+        memcpy(out, chunk->input->data + pos, edit->offset - pos);
+        out += edit->offset - pos;
+        pos = edit->offset + edit->length;
+
+        if (edit->kind == EDIT_CALL) {
+            out = emit_call(out, chunk->table, text, edit->prefix_length, edit->macro);
+        } else if (edit->kind == EDIT_TEXT) {
+            out = emit_line(out, text, edit->text_length);
+        }
     }
-    
-    /* Extract the potential macro name (first word after label if present) */
-    i = 0;
-    while (macro_start[i] && !isspace(macro_start[i]) && i < MAX_SYMBOL_LENGTH - 1) {
-        macro_name[i] = macro_start[i];
-        i++;
+    memcpy(out, chunk->input->data + pos, chunk->end - pos);
+}
+
+/**
+ * Final sweep: copies the source into the expanded text, applying the edits
+ * The source is split into up to ctx->options->threads ranges that are measured
+ * and then written in parallel; a prefix sum over their sizes gives each range
+ * its offset, so the expansions end up concatenated in source order
+ * @param ctx    Assembly context (options)
+ * @param input  Reader over the source
+ * @param table  All defined macros
+ * @param edits  The edits recorded by scan_source (candidates are resolved in place)
+ * @param output The expanded text
+ */
+static void build_expanded_text(AssemblerContext *ctx, const LineReader *input, const MacroTable *table, SourceEdits *edits, ExpandedText *output) {
+    ExpansionChunk *chunks;
+    int num_chunks;
+    size_t start = 0;
+    size_t end;
+    size_t offset = 0;
+    int first_edit = 0;
+    int last_edit;
+    int i;
+
+    /* Every range gets at least MIN_EXPANSION_CHUNK_SIZE bytes of source */
+    num_chunks = ctx->options->threads;
+    if ((size_t)num_chunks > input->size / MIN_EXPANSION_CHUNK_SIZE) {
+        num_chunks = (int)(input->size / MIN_EXPANSION_CHUNK_SIZE);
     }
-    macro_name[i] = '\0';
-    
-    if (macro_name[0] == '\0') return (char*)line;
-    
-    /* Search for matching macro */
-    for (iter = macroList; iter != NULL; iter = iter->next) {
-        if (strcmp(iter->name, macro_name) == 0) {
-            /* Found a macro to expand */
-            
-            /* Calculate total size needed for expansion */
-            total_size = 1;  /* For null terminator */
-            prefix_len = 0;
-            
-            /* If there's a label, we need to preserve it */
-            if (colon) {
-                /* Calculate length from start to where macro name starts */
-                prefix_len = macro_start - trimmed + (trimmed - line_copy);
-                /* Include original leading whitespace */
-                leading_spaces = trimmed - line_copy;
-                prefix_len += leading_spaces;
-                total_size += prefix_len;
-            }
-            
-            /* Add size for all macro lines */
-            for (j = 0; j < iter->lineCount; j++) {
-                total_size += strlen(iter->lines[j]) + 1;  /* +1 for newline */
-            }
-            
-            /* Allocate result buffer */
-            result = (char*)malloc(total_size);
-            if (!result) return (char*)line;
-            
-            result[0] = '\0';
-            
-            /* Build the expanded result */
-            if (colon && iter->lineCount > 0) {
-                /* Preserve label, replace macro name with first macro line */
-                strncat(result, line, macro_start - line_copy);
-                
-                /* Add first macro line after label */
-                strcat(result, iter->lines[0]);
-                
-                /* Add remaining macro lines (without label) */
-                for (j = 1; j < iter->lineCount; j++) {
-                    strcat(result, "\n");
-                    strcat(result, iter->lines[j]);
-                }
-            } else {
-                /* No label - just expand the macro lines */
-                for (j = 0; j < iter->lineCount; j++) {
-                    if (j > 0) strcat(result, "\n");
-                    strcat(result, iter->lines[j]);
-                }
+    if (num_chunks < 1) {
+        num_chunks = 1;
+    }
+    chunks = (ExpansionChunk *)calloc((size_t)num_chunks, sizeof(ExpansionChunk));
+    if (!chunks) {
+        fprintf(stderr, "Memory allocation error for macro expansion.\n");
+        exit(1); /* Critical error, terminate program */
+    }
+
+    /* Split the source evenly; an edit is never cut, it belongs to the range it starts in */
+    for (i = 0; i < num_chunks; i++) {
+        end = input->size;
+        last_edit = edits->count;
+        if (i < num_chunks - 1) {
+            end = start + (input->size - start) / (size_t)(num_chunks - i);
+            for (last_edit = first_edit; last_edit < edits->count && edits->items[last_edit].offset < end; last_edit++)
+                ;
+            if (last_edit > first_edit &&
+                edits->items[last_edit - 1].offset + edits->items[last_edit - 1].length > end) {
+                end = edits->items[last_edit - 1].offset + edits->items[last_edit - 1].length;
             }
-            
-            return result;  /* Return newly allocated expanded string */
         }
+        chunks[i].input = input;
+        chunks[i].table = table;
+        chunks[i].edits = edits->items + first_edit;
+        chunks[i].count = last_edit - first_edit;
+        chunks[i].start = start;
+        chunks[i].end = end;
+        start = end;
+        first_edit = last_edit;
     }
-    
-    /* No macro found - return original line */
-    return (char*)line;
+
+    runParallelTasks(num_chunks, num_chunks, measure_chunk, chunks);
+
+    /* Prefix sums of the range sizes give each range its place in the output */
+    for (i = 0; i < num_chunks; i++) {
+        offset += chunks[i].size;
+    }
+    if (offset > 0) {
+        output->data = (char *)malloc(offset);
+        if (!output->data) {
+            fprintf(stderr, "Memory allocation error for expanded source.\n");
+            exit(1); /* Critical error, terminate program */
+        }
+        output->size = offset;
+        offset = 0;
+        for (i = 0; i < num_chunks; i++) {
+            chunks[i].output = output->data + offset;
+            offset += chunks[i].size;
+        }
+        runParallelTasks(num_chunks, num_chunks, write_chunk, chunks);
+    }
+    free(chunks);
 }
 
 /**
- * Frees all memory used by the macro list
- * Cleans up the linked list and all stored macro lines
+ * Main entry point for macro processing stage
+ * This is called before the two-pass assembly begins
+ * 
+ * Process:
+ * 1. One scan of the file: collect macro definitions and record line edits
+ *    (skipped down to a length check when the file has no macro keyword)
+ * 2. One sweep: build the expanded text from the source and the edits
+ *    (split across ctx->options->threads workers for large sources)
  * 
- * @param head The head of the macro list to free
+ * @param ctx    Assembly context (error flag and diagnostics stream)
+ * @param input  Reader over the .as file (with possible macros)
+ * @param output Receives the expanded text; its buffer is malloc'd and owned by the caller
+ * @return 1 on success, 0 on failure (output is then left empty)
  */
-void freeMacroList(Macro* head) {
-    Macro *temp;
-    int i;
-    
-    /* Walk through linked list */
-    while (head) {
-        /* Free all stored lines in this macro */
-        for (i = 0; i < head->lineCount; i++) {
-            free(head->lines[i]);
-        }
-        /* Free the lines array itself */
-        free(head->lines);
-        
-        /* Move to next and free current node */
-        temp = head;
-        head = head->next;
-        free(temp);
+int preprocessMacros(AssemblerContext *ctx, LineReader *input, ExpandedText *output) {
+    MacroTable macros;  /* All macro definitions */
+    SourceEdits edits;
+
+    output->data = NULL;
+    output->size = 0;
+    initMacroTable(&macros);
+    edits.items = NULL;
+    edits.count = 0;
+    edits.capacity = 0;
+
+    rewindLineReader(input);
+    scan_source(ctx, input, &macros, &edits, contains_macro_keyword(input->data, input->size));
+    if (!ctx->has_error) {
+        build_expanded_text(ctx, input, &macros, &edits, output);
+    }
+
+    free(edits.items);
+    freeMacroTable(&macros);
+    return !ctx->has_error;
+}
+
+/**
+ * Expands the macros of a source file into an output stream
+ * 
+ * @param ctx    Assembly context (error flag and diagnostics stream)
+ * @param input  Reader over the .as file (with possible macros)
+ * @param output Output file stream (.am file with macros expanded)
+ * @return 1 on success, 0 on failure
+ */
+int create_expanded_file(AssemblerContext *ctx, LineReader* input, FILE* output) {
+    ExpandedText text;
+
+    if (!preprocessMacros(ctx, input, &text)) {
+        return 0;
     }
+    if (text.size > 0) {
+        fwrite(text.data, 1, text.size, output);
+    }
+    free(text.data);
+    return 1;
+}
+
+/**
+ * Frees the memory owned by the macro table: the hash index and the body pool
+ * The Macro structures belong to the file's arena and are released with it
+ * 
+ * @param table The macro table to free (left empty)
+ */
+void freeMacroTable(MacroTable *table) {
+    free(table->slots);
+    free(table->pool);
+    initMacroTable(table);
 }
@@ -5,11 +5,29 @@
  * This is the main file that integrates all assembler modules.
  * It processes multiple files from the command line, handles macro expansion,
  * runs the first and second passes, and writes the output files according to the project specification.
- * 
+ *
  * Key Design Decisions:
  * 1. Output files strip leading zeros for readability (matching PDF examples).
  * 2. A,R,E encoding applies only to instruction words, not data.
  * 3. Data words can use full 10-bit range including patterns ending in '11'.
+ * 4. All per-file state lives in an AssemblerContext, so files are independent
+ *    and can be assembled concurrently.
+ *
+ * Options (given before the file names):
+ *   -1, --one-pass  Encode each instruction during the first pass and patch forward
+ *                   label references from a fixup table instead of running a second pass.
+ *   -j N            Assemble up to N files at the same time. Messages of each file are
+ *                   buffered and printed in command line order once all files are done.
+ *   -t N            Split the macro expansion, the passes and the .ob formatting of
+ *                   each file across up to N threads. Source ranges are expanded, lines
+ *                   parsed, instructions encoded and object lines formatted in chunks;
+ *                   labels, messages and external references still follow source order.
+ *   --ext-order=address, --ext-order=symbol
+ *                   Order the .ext file by the address of each reference, or group it
+ *                   by symbol (the default: newest symbol first, newest reference first).
+ *   --no-am         Do not save the macro-expanded source as a .am file. The first pass
+ *                   always reads the expanded source from memory; the .am file is only
+ *                   written for inspection.
  */
 
 #include <stdio.h>
@@ -21,168 +39,272 @@
 #include "first_pass.h"
 #include "second_pass.h"
 #include "output_files.h"
+#include "thread_pool.h"
+#include "arena.h"
+#include "line_reader.h"
 
-/* Helper function to skip leading whitespace in a string*/
-static const char *skip_whitespace_macro(const char *str) {
-    while (*str == ' ' || *str == '\t') {
-        str++;
+/**
+ * @brief One command line file together with its context and buffered messages (-j mode).
+ */
+typedef struct FileJob {
+    const char *base_name;   /* File name as given on the command line (without .as) */
+    AssemblerContext ctx;    /* Per-file error flag and message streams */
+    char *out_text;          /* Buffered progress messages */
+    size_t out_size;
+    char *err_text;          /* Buffered diagnostics */
+    size_t err_size;
+} FileJob;
+
+/**
+ * Saves the expanded source as the .am file.
+ * @param text The expanded source.
+ * @param am_file_name Name of the file to create.
+ * @return 1 on success, 0 if the file cannot be created or written.
+ */
+static int write_am_file(const ExpandedText *text, const char *am_file_name) {
+    FILE *am_file_stream = fopen(am_file_name, "w");
+    int ok;
+
+    if (!am_file_stream) {
+        return 0;
     }
-    return str;
+    ok = text->size == 0 || fwrite(text->data, 1, text->size, am_file_stream) == text->size;
+    if (fclose(am_file_stream) != 0) ok = 0;
+    return ok;
 }
 
-/* Global error flag definition. This is the only place it is defined.*/
-/* Other files use 'extern int g_has_error;' to refer to it.*/
-int g_has_error = 0;
+/* Prints the command line synopsis */
+static void print_usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-1|--one-pass] [-j N] [-t N] [--ext-order=address|symbol] [--no-am] <file1_basename> <file2_basename> ...\n", program_name);
+}
 
-int main(int argc, char *argv[]) {
-    int i; /* Loop counter for processing multiple files */
+/**
+ * Assembles a single source file: macro expansion, both passes and output files.
+ * All messages go to the context's streams.
+ * @param ctx The context of this file (options and streams must be set).
+ * @param base_name The file name without the .as extension.
+ */
+static void assemble_file(AssemblerContext *ctx, const char *base_name) {
+    char input_file_base_name[252];
+    char full_input_file_name[300];
+    char am_file_name[300];
+    LineReader source;
+    LineReader expanded_source;
+    ExpandedText expanded_text;
+    SymbolTable symbol_table;
+    Instruction *instruction_list = NULL;
+    DataSegment data_segment;
+    int final_ic = 0;
+    int final_dc = 0;
+    FixupTable fixups;
+    int one_pass = ctx->options->one_pass;
 
-    int inside_macro_def = 0; /* Flag to track if we're inside a macro definition */
+    /* --- Reset all data for the new file ---*/
+    strncpy(input_file_base_name, base_name, sizeof(input_file_base_name) - 1);
+    input_file_base_name[sizeof(input_file_base_name) - 1] = '\0';
 
-    Instruction *tempInst;
-    DataItem *tempData;
+    sprintf(full_input_file_name, "%s.as", input_file_base_name);
 
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <file1_basename> <file2_basename> ...\n", argv[0]);
-        return 1;
+    ctx->has_error = 0; /* Reset for each new file*/
+    initArena(&ctx->arena);
+    initSymbolTable(&symbol_table);
+    initFixupTable(&fixups);
+    initDataSegment(&data_segment);
+
+    fprintf(ctx->out, "\n--- Processing file: %s ---\n", full_input_file_name);
+
+    /* The source is loaded once and scanned in memory */
+    if (!openLineReader(&source, full_input_file_name)) {
+        fprintf(ctx->err, "Error: Cannot open input file: %s. Skipping.\n", full_input_file_name);
+        return; /* Skip to the next file*/
     }
 
-    /* Loop to process each file provided as a command-line argument*/
-    for (i = 1; i < argc; i++) {
-        char input_file_base_name[252];
-        char full_input_file_name[300];
-        char am_file_name[300];
-        FILE *input_file_stream = NULL;
-        FILE *am_file_stream = NULL;
-        Macro *macro_list = NULL;
-        char line[MAX_LINE_LENGTH + 2];
-        char *expanded_line_content;
-        Symbol *symbol_table = NULL;
-        Instruction *instruction_list = NULL;
-        DataItem *data_list = NULL;
-        int final_ic = 0;
-        int final_dc = 0;
-
-        /* --- Reset all data for the new file ---*/
-        strncpy(input_file_base_name, argv[i], sizeof(input_file_base_name) - 1);
-        input_file_base_name[sizeof(input_file_base_name) - 1] = '\0';
-        
-        sprintf(full_input_file_name, "%s.as", input_file_base_name);
-
-        g_has_error = 0; /* Reset for each new file*/
-
-        printf("\n--- Processing file: %s ---\n", full_input_file_name);
-
-        input_file_stream = fopen(full_input_file_name, "r");
-        if (!input_file_stream) {
-            fprintf(stderr, "Error: Cannot open input file: %s. Skipping.\n", full_input_file_name);
-            continue; /* Skip to the next file*/
-        }
+    /* --- 1. Macro Processing ---*/
+    /* Definitions and calls are handled in one scan; the result stays in memory */
+    if (!preprocessMacros(ctx, &source, &expanded_text)) {
+        fprintf(ctx->err, "Errors found during macro definition processing for %s. Halting assembly for this file.\n", full_input_file_name);
+        closeLineReader(&source);
+        freeArena(&ctx->arena); /* Macros defined so far */
+        return; /* Skip to the next file */
+    }
+    closeLineReader(&source);
 
-        /* --- 1. Macro Processing ---*/
-        macro_list = processMacroDefinitions(input_file_stream);
-        if (g_has_error) {
-            fprintf(stderr, "Errors found during macro definition processing for %s. Halting assembly for this file.\n", full_input_file_name);
-            fclose(input_file_stream);
-            freeMacroList(macro_list);
-            continue; /* Skip to the next file */
+    if (ctx->options->write_am) {
+        sprintf(am_file_name, "%s.am", input_file_base_name);
+        if (!write_am_file(&expanded_text, am_file_name)) {
+            fprintf(ctx->err, "Error: Cannot create .am file: %s. Halting assembly for this file.\n", am_file_name);
+            free(expanded_text.data);
+            freeArena(&ctx->arena);
+            return; /* Skip to the next file */
         }
+    }
 
-        sprintf(am_file_name, "%s.am", input_file_base_name);
-        am_file_stream = fopen(am_file_name, "w+");
-        if (!am_file_stream) {
-            fprintf(stderr, "Error: Cannot create .am file: %s. Halting assembly for this file.\n", am_file_name);
-            fclose(input_file_stream);
-            freeMacroList(macro_list);
-            continue; /* Skip to the next file */
+    /* The reader takes over the buffer and frees it when closed */
+    openLineReaderFromBuffer(&expanded_source, expanded_text.data, expanded_text.size);
+
+    /* --- 2. First Pass ---*/
+    /* In one-pass mode instructions are encoded here and label words are deferred */
+    if (!firstPass(ctx, &expanded_source, &symbol_table, &instruction_list, &data_segment, &final_ic, &final_dc,
+                   one_pass ? &fixups : NULL)) {
+        ctx->has_error = 1; /* Ensure error is flagged*/
+    }
+    closeLineReader(&expanded_source);
+
+    /* --- 3. Second Pass (or fixup resolution in one-pass mode) ---*/
+    if (!ctx->has_error) {
+        if (one_pass) {
+            if (!resolveFixups(ctx, &fixups, &symbol_table)) {
+                ctx->has_error = 1; /* Ensure error is flagged*/
+            }
+        } else if (!secondPass(ctx, instruction_list, &symbol_table)) {
+            ctx->has_error = 1; /* Ensure error is flagged*/
         }
-        
-        rewind(input_file_stream);
-        
-        while (fgets(line, sizeof(line), input_file_stream)) {
-            const char *trimmed = skip_whitespace_macro(line);
-            
-            /* Extract the first word from the line to check for macro keywords */
-            char first_word[MAX_SYMBOL_LENGTH];
-            if (sscanf(trimmed, "%s", first_word) == 1) {
-                /* Check if this is the start of a macro definition */
-                if (strcmp(first_word, "mcro") == 0) {
-                    inside_macro_def = 1; /* Set flag - we're now inside a macro */
-                    continue; /* Skip the "mcro" line itself */
-                }
-                /* Check if this is the end of a macro definition */
-                else if (strcmp(first_word, "mcroend") == 0) {
-                    inside_macro_def = 0; /* Clear flag - macro definition ended */
-                    continue; /* Skip the "mcroend" line itself */
-                }
+    }
+
+    /* --- 4. Write Output Files  --- */
+    if (ctx->has_error) {
+        fprintf(ctx->err, "Errors detected during assembly. No output files generated for %s.\n", input_file_base_name);
+    } else {
+        fprintf(ctx->out, "Generating output files for %s...\n", input_file_base_name);
+
+        /* Pass just the base name to the output functions - they will add extensions */
+        /* The .ob file header requires the LENGTH of the instruction code, not the final address. */
+        writeObjectFile(ctx, input_file_base_name, final_ic - MEMORY_START, final_dc, &data_segment, instruction_list);
+        writeEntriesFile(ctx, input_file_base_name, &symbol_table);
+        writeExternalsFile(ctx, input_file_base_name, &symbol_table);
+    }
+
+    /* --- 5. Memory Cleanup for this file's data --- */
+    /* Instructions and symbols live in the arena */
+    freeSymbolTable(&symbol_table);
+    freeDataSegment(&data_segment);
+    freeFixupTable(&fixups);
+    freeArena(&ctx->arena);
+    fprintf(ctx->out, "--- Finished processing %s ---\n", full_input_file_name);
+}
+
+/**
+ * Worker task for -j mode: assembles one file with its messages captured in memory.
+ * @param jobs_ptr The FileJob array.
+ * @param index Index of the job to run.
+ */
+static void assemble_job(void *jobs_ptr, int index) {
+    FileJob *job = (FileJob *)jobs_ptr + index;
+
+    /* Fall back to the real streams if a buffer cannot be created */
+    job->ctx.out = open_memstream(&job->out_text, &job->out_size);
+    if (!job->ctx.out) job->ctx.out = stdout;
+    job->ctx.err = open_memstream(&job->err_text, &job->err_size);
+    if (!job->ctx.err) job->ctx.err = stderr;
+
+    assemble_file(&job->ctx, job->base_name);
+
+    /* Closing a memory stream finalizes its buffer and size */
+    if (job->ctx.out != stdout) fclose(job->ctx.out);
+    if (job->ctx.err != stderr) fclose(job->ctx.err);
+}
+
+int main(int argc, char *argv[]) {
+    int i; /* Loop counter for processing multiple files */
+    int first_file; /* Index of the first file name in argv */
+    int num_files;
+    AssemblerOptions options;
+    AssemblerContext ctx;
+    FileJob *jobs;
+    const char *jobs_arg;
+    const char *threads_arg;
+
+    options.one_pass = 0;
+    options.jobs = 1;
+    options.threads = 1;
+    options.write_am = 1;
+    options.ext_order = EXT_ORDER_SYMBOL;
+
+    /* Parse options; everything after them is a file name */
+    for (first_file = 1; first_file < argc && argv[first_file][0] == '-'; first_file++) {
+        if (strcmp(argv[first_file], "-1") == 0 || strcmp(argv[first_file], "--one-pass") == 0) {
+            options.one_pass = 1;
+        } else if (strcmp(argv[first_file], "--no-am") == 0) {
+            options.write_am = 0;
+        } else if (strcmp(argv[first_file], "--ext-order=address") == 0) {
+            options.ext_order = EXT_ORDER_ADDRESS;
+        } else if (strcmp(argv[first_file], "--ext-order=symbol") == 0) {
+            options.ext_order = EXT_ORDER_SYMBOL;
+        } else if (strncmp(argv[first_file], "-j", 2) == 0) {
+            /* Accept both "-j N" and "-jN" */
+            jobs_arg = argv[first_file] + 2;
+            if (*jobs_arg == '\0' && first_file + 1 < argc) {
+                jobs_arg = argv[++first_file];
             }
-            
-            /* If we're inside a macro definition, skip this line entirely */
-            /* This ensures macro body lines don't appear in the .am file */
-            if (inside_macro_def) {
-                continue;
+            options.jobs = atoi(jobs_arg);
+            if (options.jobs < 1) {
+                fprintf(stderr, "Invalid job count for -j: '%s'\n", jobs_arg);
+                print_usage(argv[0]);
+                return 1;
             }
-            
-            /* For all other lines (outside macro definitions), expand any macro calls */
-            expanded_line_content = expandMacroInLine(line, macro_list);
-
-            /* First, write the content to the .am file */
-            if (strlen(expanded_line_content) > 0 && 
-                expanded_line_content[strlen(expanded_line_content) - 1] != '\n') {
-                fprintf(am_file_stream, "%s\n", expanded_line_content);
-            } else {
-                fprintf(am_file_stream, "%s", expanded_line_content);
+        } else if (strncmp(argv[first_file], "-t", 2) == 0) {
+            /* Accept both "-t N" and "-tN" */
+            threads_arg = argv[first_file] + 2;
+            if (*threads_arg == '\0' && first_file + 1 < argc) {
+                threads_arg = argv[++first_file];
             }
-
-            /*  free the memory ONLY if a new string was allocated */
-            if (expanded_line_content != line) {
-                free(expanded_line_content);
+            options.threads = atoi(threads_arg);
+            if (options.threads < 1) {
+                fprintf(stderr, "Invalid thread count for -t: '%s'\n", threads_arg);
+                print_usage(argv[0]);
+                return 1;
             }
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[first_file]);
+            print_usage(argv[0]);
+            return 1;
         }
-        freeMacroList(macro_list);
-        fclose(input_file_stream);
-        rewind(am_file_stream);
+    }
 
-        /* --- 2. First Pass ---*/
-        if (!firstPass(am_file_stream, &symbol_table, &instruction_list, &data_list, &final_ic, &final_dc)) {
-            g_has_error = 1; /* Ensure error is flagged*/
-        }
-        fclose(am_file_stream);
+    if (first_file >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    num_files = argc - first_file;
 
-        /* --- 3. Second Pass ---*/
-        if (!g_has_error) {
-            if (!secondPass(instruction_list, symbol_table)) {
-                g_has_error = 1; /* Ensure error is flagged*/
-            }
-        }
-        
-        /* --- 4. Write Output Files  --- */
-        if (g_has_error) {
-            fprintf(stderr, "Errors detected during assembly. No output files generated for %s.\n", input_file_base_name);
-        } else {
-            printf("Generating output files for %s...\n", input_file_base_name);
-            
-            /* Pass just the base name to the output functions - they will add extensions */
-            /* The .ob file header requires the LENGTH of the instruction code, not the final address. */
-            writeObjectFile(input_file_base_name, final_ic - MEMORY_START, final_dc, data_list, instruction_list);
-            writeEntriesFile(input_file_base_name, symbol_table);
-            writeExternalsFile(input_file_base_name, symbol_table);
+    /* Sequential mode: messages go straight to the terminal */
+    if (options.jobs == 1 || num_files == 1) {
+        ctx.options = &options;
+        ctx.out = stdout;
+        ctx.err = stderr;
+        for (i = first_file; i < argc; i++) {
+            assemble_file(&ctx, argv[i]);
         }
+        return 0; /* Main returns 0, success/failure is per-file. */
+    }
 
-        /* --- 5. Memory Cleanup for this file's data --- */
-        freeSymbolTable(symbol_table);
-        while (instruction_list) {
-            tempInst = instruction_list;
-            instruction_list = instruction_list->next;
-            free(tempInst);
+    /* Parallel mode: one job per file, each with its own context and buffers */
+    jobs = (FileJob *)calloc((size_t)num_files, sizeof(FileJob));
+    if (!jobs) {
+        fprintf(stderr, "Memory allocation error for file jobs.\n");
+        return 1;
+    }
+    for (i = 0; i < num_files; i++) {
+        jobs[i].base_name = argv[first_file + i];
+        jobs[i].ctx.options = &options;
+    }
+
+    runParallelTasks(options.jobs, num_files, assemble_job, jobs);
+
+    /* Replay every file's messages in command line order */
+    for (i = 0; i < num_files; i++) {
+        if (jobs[i].out_text) {
+            fwrite(jobs[i].out_text, 1, jobs[i].out_size, stdout);
+            fflush(stdout);
         }
-        while (data_list) {
-            tempData = data_list;
-            data_list = data_list->next;
-            free(tempData);
+        if (jobs[i].err_text) {
+            fwrite(jobs[i].err_text, 1, jobs[i].err_size, stderr);
+            fflush(stderr);
         }
-        printf("--- Finished processing %s ---\n", full_input_file_name);
-    } /* End of loop for processing files */
+        free(jobs[i].out_text);
+        free(jobs[i].err_text);
+    }
+    free(jobs);
 
     return 0; /* Main returns 0, success/failure is per-file. */
-}
\ No newline at end of file
+}
@@ -0,0 +1,71 @@
+/* opcodes.c */
+/**
+ * @file opcodes.c
+ * @brief Implements the opcode descriptor table and mnemonic lookup.
+ */
+
+#include "opcodes.h"
+#include <string.h> /* For strcmp */
+
+/* Shorthands for the mode masks used in the table below */
+#define ALL_MODES (MODE_MASK(ADDR_IMMEDIATE) | MODE_MASK(ADDR_DIRECT) | MODE_MASK(ADDR_MATRIX) | MODE_MASK(ADDR_REGISTER))
+#define NO_IMMEDIATE (MODE_MASK(ADDR_DIRECT) | MODE_MASK(ADDR_MATRIX) | MODE_MASK(ADDR_REGISTER))
+#define MEMORY_ONLY (MODE_MASK(ADDR_DIRECT) | MODE_MASK(ADDR_MATRIX))
+
+/* Indexed by Opcode value */
+static const OpcodeInfo opcode_table[NUM_OPCODES] = {
+    {"mov",  2, ALL_MODES,   NO_IMMEDIATE}, /* src: all modes, dest: no immediate */
+    {"cmp",  2, ALL_MODES,   ALL_MODES},    /* src: all modes, dest: all modes */
+    {"add",  2, ALL_MODES,   NO_IMMEDIATE},
+    {"sub",  2, ALL_MODES,   NO_IMMEDIATE},
+    {"not",  1, 0,           NO_IMMEDIATE}, /* single operand */
+    {"clr",  1, 0,           NO_IMMEDIATE},
+    {"lea",  2, MEMORY_ONLY, NO_IMMEDIATE}, /* src: no immediate/register */
+    {"inc",  1, 0,           NO_IMMEDIATE},
+    {"dec",  1, 0,           NO_IMMEDIATE},
+    {"jmp",  1, 0,           MEMORY_ONLY},  /* no register */
+    {"bne",  1, 0,           MEMORY_ONLY},
+    {"red",  1, 0,           NO_IMMEDIATE},
+    {"prn",  1, 0,           ALL_MODES},    /* can print anything */
+    {"jsr",  1, 0,           MEMORY_ONLY},
+    {"rts",  0, 0,           0},            /* no operands */
+    {"stop", 0, 0,           0}
+};
+
+/**
+ * @brief Finds the opcode of a mnemonic.
+ * The first character (and the second where two mnemonics share it) selects the
+ * only possible candidate, which is then confirmed with a single strcmp.
+ * @param name The mnemonic to look up.
+ * @return The Opcode value, or -1 if 'name' is not an opcode.
+ */
+int findOpcode(const char *name) {
+    int candidate;
+
+    switch (name[0]) {
+        case 'a': candidate = OPCODE_ADD; break;
+        case 'b': candidate = OPCODE_BNE; break;
+        case 'c': candidate = (name[1] == 'm') ? OPCODE_CMP : OPCODE_CLR; break;
+        case 'd': candidate = OPCODE_DEC; break;
+        case 'i': candidate = OPCODE_INC; break;
+        case 'j': candidate = (name[1] == 'm') ? OPCODE_JMP : OPCODE_JSR; break;
+        case 'l': candidate = OPCODE_LEA; break;
+        case 'm': candidate = OPCODE_MOV; break;
+        case 'n': candidate = OPCODE_NOT; break;
+        case 'p': candidate = OPCODE_PRN; break;
+        case 'r': candidate = (name[1] == 'e') ? OPCODE_RED : OPCODE_RTS; break;
+        case 's': candidate = (name[1] == 'u') ? OPCODE_SUB : OPCODE_STOP; break;
+        default: return -1;
+    }
+
+    return strcmp(name, opcode_table[candidate].name) == 0 ? candidate : -1;
+}
+
+/**
+ * @brief Returns the descriptor of an opcode.
+ * @param opcode An Opcode value (0 to NUM_OPCODES - 1).
+ * @return Pointer to the static descriptor.
+ */
+const OpcodeInfo* getOpcodeInfo(int opcode) {
+    return &opcode_table[opcode];
+}
@@ -7,21 +7,283 @@
  * 1. Object file (.ob) - Machine code in base-4 format
  * 2. Entries file (.ent) - List of entry points and their addresses
  * 3. Externals file (.ext) - List of external symbol usage locations
+ *
+ * Each file is formatted into one buffer whose size is known in advance and
+ * handed to the system with positional writes. Every .ob line has the same
+ * width, so ranges of the object file are formatted in parallel, each at its
+ * own offset in the buffer.
  */
 
+#define _POSIX_C_SOURCE 200809L /* For pwrite */
 #include "output_files.h"
 #include "assembler.h"
 #include "convertToBase4.h"
+#include "thread_pool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>    /* For CHAR_BIT */
+#include <errno.h>     /* For errno, EINTR */
+#include <fcntl.h>     /* For open */
+#include <unistd.h>    /* For pwrite, close */
 
 #ifndef MAX_FILENAME_LENGTH
 #define MAX_FILENAME_LENGTH 256
 #endif
 
-/* --- External dependency: global error flag --- */
-extern int g_has_error;
+/* Every .ob line after the header is "address<TAB>word\n" */
+#define OB_LINE_LENGTH (2 * BASE4_WORD_LENGTH + 2)
+
+/* Longest .ob header: "ICF DCF\n" with both counts at full width */
+#define OB_HEADER_MAX_LENGTH (2 * BASE4_WORD_LENGTH + 2)
+
+/* Every .ent/.ext line is "name address\n"; this is its length without the name */
+#define SYMBOL_LINE_EXTRA_LENGTH (BASE4_WORD_LENGTH + 2)
+
+/* External references are ordered by a radix sort on 8-bit digits of their key */
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+/**
+ * @brief A run of consecutive .ob lines formatted by one worker:
+ * either instructions or data words, never both.
+ */
+typedef struct ObjectRange {
+    const Instruction *inst;  /* First instruction of the range, or NULL for a data range */
+    const int16_t *data;      /* First explicit data word at or after the start of a data range */
+    const ZeroRun *runs;      /* First zero run that ends after the start of a data range */
+    const ZeroRun *runs_end;  /* End of the data segment's zero runs */
+    int count;                /* Number of instructions or data words */
+    int dc;                   /* DC value of the range's first data word */
+    int data_base;            /* Address of data word 0 (MEMORY_START + ICF) */
+    char *out;                /* Position of the range's first line in the buffer */
+} ObjectRange;
+
+/* --- Buffer Helpers --- */
+
+/**
+ * Allocates the output buffer of one file
+ * @param size Number of bytes the file will contain
+ * @return The buffer (terminates the program if memory runs out)
+ */
+static char* alloc_output_buffer(size_t size) {
+    char *buffer = (char *)malloc(size ? size : 1);
+    if (!buffer) {
+        fprintf(stderr, "Memory allocation error for output buffer.\n");
+        exit(1); /* Critical error, terminate program */
+    }
+    return buffer;
+}
+
+/**
+ * Appends the 5-digit base-4 text of a value
+ * @param p Write position
+ * @param value Value to convert (masked to 10 bits)
+ * @return The position after the digits
+ */
+static char* put_base4(char *p, int value) {
+    char digits[BASE4_WORD_LENGTH + 1];
+
+    convertToBase4Buffer(value, digits);
+    memcpy(p, digits, BASE4_WORD_LENGTH);
+    return p + BASE4_WORD_LENGTH;
+}
+
+/**
+ * Appends one "name address\n" line of the .ent and .ext files
+ * @param p Write position
+ * @param name Symbol name
+ * @param address Address to print in base-4
+ * @return The position after the line
+ */
+static char* put_symbol_line(char *p, const char *name, int address) {
+    size_t len = strlen(name);
+
+    memcpy(p, name, len);
+    p += len;
+    *p++ = ' ';
+    p = put_base4(p, address);
+    *p++ = '\n';
+    return p;
+}
+
+/**
+ * Writes a whole buffer to the start of a file, continuing after short writes
+ * @param fd Descriptor of the file
+ * @param buffer Contents of the file
+ * @param len Number of bytes in 'buffer'
+ * @return 1 on success, 0 on failure
+ */
+static int pwrite_all(int fd, const char *buffer, size_t len) {
+    size_t done = 0;
+    ssize_t written;
+
+    while (done < len) {
+        written = pwrite(fd, buffer + done, len - done, (off_t)done);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return 0;
+        done += (size_t)written;
+    }
+    return 1;
+}
+
+/**
+ * Creates an output file and writes a whole formatted buffer to it at once
+ * Any failure is reported and flags the file as failed
+ * @param ctx Assembly context (error flag and message streams)
+ * @param path Name of the file to create
+ * @param kind Description used in the error message (e.g. "object")
+ * @param buffer Contents of the file
+ * @param len Number of bytes in 'buffer'
+ * @return 1 on success, 0 on failure
+ */
+static int write_output_file(AssemblerContext *ctx, const char *path, const char *kind, const char *buffer, size_t len) {
+    int fd;
+    int ok;
+
+    /* Same permissions as fopen(path, "w") */
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        fprintf(ctx->err, "Error: Cannot create %s file '%s'.\n", kind, path);
+        ctx->has_error = 1;
+        return 0;
+    }
+
+    /* The buffer already holds the whole file, so it goes to the kernel without stdio */
+    ok = pwrite_all(fd, buffer, len);
+    if (close(fd) != 0) ok = 0;
+
+    if (!ok) {
+        fprintf(ctx->err, "Error: Failed to write %s file '%s'.\n", kind, path);
+        ctx->has_error = 1;
+    }
+    return ok;
+}
+
+/**
+ * Splits the instructions into ranges of about the same number of words
+ * @param list First instruction
+ * @param total_words Number of instruction words (ICF)
+ * @param parts Maximum number of ranges
+ * @param out Position of the first instruction line in the buffer
+ * @param ranges Receives the ranges
+ * @param words Receives the number of words of all instructions
+ * @return Number of ranges created
+ */
+static int split_instructions(const Instruction *list, int total_words, int parts, char *out, ObjectRange *ranges, long *words) {
+    const Instruction *inst;
+    int n = 0;
+
+    *words = 0;
+    for (inst = list; inst; inst = inst->next) {
+        /* A new range starts at the first instruction past each share */
+        if (n < parts && *words >= (long)total_words * n / parts) {
+            ranges[n].inst = inst;
+            ranges[n].data = NULL;
+            ranges[n].count = 0;
+            ranges[n].out = out + *words * OB_LINE_LENGTH;
+            n++;
+        }
+        ranges[n - 1].count++;
+        *words += inst->num_operand_words + 1;
+    }
+    return n;
+}
+
+/**
+ * Splits the data segment into ranges of about the same length
+ * @param data Data segment
+ * @param parts Maximum number of ranges
+ * @param data_base Address of data word 0
+ * @param out Position of the first data line in the buffer
+ * @param ranges Receives the ranges
+ * @param words Receives the number of data words
+ * @return Number of ranges created
+ */
+static int split_data(const DataSegment *data, int parts, int data_base, char *out, ObjectRange *ranges, long *words) {
+    const ZeroRun *run = data->runs;
+    const ZeroRun *runs_end = data->runs + data->num_runs;
+    int zeros = 0;  /* Zero words in the runs before 'run' */
+    int n;
+    int first, stored;
+
+    *words = data->count;
+    if (parts > data->count) parts = data->count;
+    for (n = 0; n < parts; n++) {
+        first = (int)((long)data->count * n / parts);
+
+        /* Explicit words before 'first' are those not covered by a run */
+        while (run < runs_end && run->offset + run->count <= first) {
+            zeros += run->count;
+            run++;
+        }
+        stored = first - zeros;
+        if (run < runs_end && run->offset < first) {
+            stored -= first - run->offset;
+        }
+
+        ranges[n].inst = NULL;
+        ranges[n].data = data->words + stored;
+        ranges[n].runs = run;
+        ranges[n].runs_end = runs_end;
+        ranges[n].count = (int)((long)data->count * (n + 1) / parts) - first;
+        ranges[n].dc = first;
+        ranges[n].data_base = data_base;
+        ranges[n].out = out + (long)first * OB_LINE_LENGTH;
+    }
+    return parts;
+}
+
+/**
+ * Formats one range of .ob lines at its place in the buffer
+ * @param ranges_ptr The ObjectRange array
+ * @param index Index of the range
+ */
+static void format_object_range(void *ranges_ptr, int index) {
+    const ObjectRange *range = (const ObjectRange *)ranges_ptr + index;
+    const Instruction *inst = range->inst;
+    const int16_t *data = range->data;
+    const ZeroRun *run = range->runs;
+    char *p = range->out;
+    int n, i;
+    int dc, stop, end;
+    int zero;
+
+    if (inst) {
+        for (n = 0; n < range->count; n++, inst = inst->next) {
+            /* The opcode word is followed immediately by the operand words */
+            for (i = 0; i <= inst->num_operand_words; i++) {
+                /* Address and machine code separated by tab */
+                p = put_base4(p, inst->address + i);
+                *p++ = '\t';
+                p = put_base4(p, inst->words[i]);
+                *p++ = '\n';
+            }
+        }
+        return;
+    }
+
+    /* Explicit words and zero runs alternate; runs are expanded only here */
+    dc = range->dc;
+    end = range->dc + range->count;
+    while (dc < end) {
+        zero = run < range->runs_end && run->offset <= dc;
+        if (zero) {
+            stop = run->offset + run->count;
+            run++;
+        } else {
+            stop = run < range->runs_end ? run->offset : end;
+        }
+        if (stop > end) stop = end;
+        for (; dc < stop; dc++) {
+            /* Data starts at: MEMORY_START + ICF (after all instructions) */
+            p = put_base4(p, range->data_base + dc);
+            *p++ = '\t';
+            p = put_base4(p, zero ? 0 : *data++);
+            *p++ = '\n';
+        }
+    }
+}
 
 /**
  * Writes the main object file containing all machine code
@@ -33,150 +295,71 @@ extern int g_has_error;
  * - All instruction words with their addresses
  * - All data values with their addresses (after instructions)
  * 
+ * There is exactly one line per word, so the file size follows from ICF and DCF,
+ * and every line's offset from the number of words before it. With -t N the
+ * instructions and data words are split into ranges formatted in parallel.
+ * 
+ * @param ctx Assembly context (error flag and message streams)
  * @param filename Base filename (without extension)
  * @param ICF Instruction Code Final - total instruction words used
  * @param DCF Data Counter Final - total data words used
- * @param dataList Linked list of data items to write
+ * @param data Data segment to write
  * @param instructionList Linked list of instructions to write
  */
-void writeObjectFile(const char *filename, int ICF, int DCF, DataItem *dataList, Instruction *instructionList) {
+void writeObjectFile(AssemblerContext *ctx, const char *filename, int ICF, int DCF, const DataSegment *data, Instruction *instructionList) {
     /* All variables declared at top for C90 compliance */
-    FILE *file;
     char obj_filename[MAX_FILENAME_LENGTH];
-    char *base4_address;
-    char *base4_value;
-    char *base4_icf;
-    char *base4_dcf;
-    char *stripped_icf;  /* For removing leading 'a's from header */
-    char *stripped_dcf;  /* For removing leading 'a's from header */
-    Instruction *inst;
-    DataItem *data;
-    int i;
+    char base4_icf[BASE4_WORD_LENGTH + 1];
+    char base4_dcf[BASE4_WORD_LENGTH + 1];
+    char *buffer;
+    char *body;
+    ObjectRange *ranges;
+    int inst_parts, data_parts;
+    int num_ranges;
+    long inst_words, data_words;
 
     /* Create output filename */
     sprintf(obj_filename, "%s.ob", filename);
-    
-    /* Open file for writing */
-    file = fopen(obj_filename, "w");
-    if (!file) {
-        fprintf(stderr, "Error: Cannot create object file '%s'.\n", obj_filename);
-        g_has_error = 1;
-        return;
-    }
+
+    /* One extra byte for the terminator sprintf writes after the header */
+    buffer = alloc_output_buffer(OB_HEADER_MAX_LENGTH + 1 + (size_t)(ICF + DCF) * OB_LINE_LENGTH);
 
     /* --- Part 1: Write header line --- */
     /* Header contains instruction count and data count in base-4 */
-    
-    /* Convert counts to base-4 */
-    base4_icf = convertToBase4(ICF);
-    base4_dcf = convertToBase4(DCF);
-    if (!base4_icf || !base4_dcf) {
-        fprintf(stderr, "Error: Memory allocation failed for header.\n");
-        g_has_error = 1; 
-        fclose(file); 
-        return;
-    }
+    convertToBase4Buffer(ICF, base4_icf);
+    convertToBase4Buffer(DCF, base4_dcf);
     
     /* Strip leading 'a's (zeros) for cleaner output format */
     /* This matches the expected format in the course PDF */
-    stripped_icf = stripLeadingA(base4_icf);
-    stripped_dcf = stripLeadingA(base4_dcf);
-    
-    if (!stripped_icf || !stripped_dcf) {
-        fprintf(stderr, "Error: Memory allocation failed for stripped header.\n");
-        free(base4_icf);
-        free(base4_dcf);
-        g_has_error = 1; 
-        fclose(file); 
-        return;
-    }
-    
-    /* Write the header line */
-    fprintf(file, "%s %s\n", stripped_icf, stripped_dcf);
-    
-    /* Clean up header memory */
-    free(base4_icf);
-    free(base4_dcf);
-    free(stripped_icf);
-    free(stripped_dcf);
-
-    /* --- Part 2: Write all instructions --- */
-    /* Each instruction may span multiple words (1-5 words) */
-    
-    inst = instructionList;
-    while (inst) {
-        /* Write main instruction word */
-        base4_address = convertToBase4(inst->address);
-        if (!base4_address) {
-            fprintf(stderr, "Error: Memory allocation failed for instruction address.\n");
-            g_has_error = 1; 
-            fclose(file); 
-            return;
-        }
-        
-        /* Address and machine code separated by tab */
-        fprintf(file, "%s\t%s\n", base4_address, inst->machine_code_base4);
-        free(base4_address);
-
-        /* Write additional operand words if present */
-        /* These follow immediately after the main instruction */
-        for (i = 0; i < inst->num_operand_words; i++) {
-            /* Calculate address for this operand word */
-            base4_address = convertToBase4(inst->address + i + 1);
-            if (!base4_address) {
-                fprintf(stderr, "Error: Memory allocation failed for operand word address.\n");
-                g_has_error = 1; 
-                fclose(file); 
-                return;
-            }
-            
-            /* Write operand word */
-            fprintf(file, "%s\t%s\n", base4_address, inst->operand_words_base4[i]);
-            free(base4_address);
-        }
-        
-        /* Move to next instruction */
-        inst = inst->next;
-    }
+    body = buffer + sprintf(buffer, "%s %s\n", skipLeadingA(base4_icf), skipLeadingA(base4_dcf));
 
-    /* --- Part 3: Write all data values --- */
-    /* Data section comes after all instructions in memory */
-    
-    data = dataList;
-    while (data) {
-        /* Calculate actual memory address for data */
-        /* Data starts at: MEMORY_START + ICF (after all instructions) */
-        base4_address = convertToBase4(data->address + ICF + MEMORY_START);
-        if (!base4_address) {
-            fprintf(stderr, "Error: Memory allocation failed for data item address.\n");
-            g_has_error = 1; 
-            fclose(file); 
-            return;
-        }
-        
-        /* Convert data value to base-4 */
-        base4_value = convertToBase4(data->value);
-        if (!base4_value) {
-            fprintf(stderr, "Error: Memory allocation failed for data value.\n");
-            free(base4_address); 
-            g_has_error = 1; 
-            fclose(file); 
-            return;
-        }
-        
-        /* Write data word */
-        fprintf(file, "%s\t%s\n", base4_address, base4_value);
-        
-        /* Clean up */
-        free(base4_address);
-        free(base4_value);
-        
-        /* Move to next data item */
-        data = data->next;
+    /* --- Part 2: Split instructions and data into ranges of whole lines --- */
+    /* Each instruction may span multiple words (1-5 words); data comes after all instructions */
+    inst_parts = ctx->options->threads;
+    if (inst_parts > ICF / MIN_OBJECT_CHUNK_WORDS) inst_parts = ICF / MIN_OBJECT_CHUNK_WORDS;
+    if (inst_parts < 1) inst_parts = 1;
+    data_parts = ctx->options->threads;
+    if (data_parts > DCF / MIN_OBJECT_CHUNK_WORDS) data_parts = DCF / MIN_OBJECT_CHUNK_WORDS;
+    if (data_parts < 1) data_parts = 1;
+
+    ranges = (ObjectRange *)malloc((size_t)(inst_parts + data_parts) * sizeof(ObjectRange));
+    if (!ranges) {
+        fprintf(stderr, "Memory allocation error for object file ranges.\n");
+        exit(1); /* Critical error, terminate program */
     }
+    num_ranges = split_instructions(instructionList, ICF, inst_parts, body, ranges, &inst_words);
+    num_ranges += split_data(data, data_parts, ICF + MEMORY_START, body + inst_words * OB_LINE_LENGTH,
+                             ranges + num_ranges, &data_words);
 
-    fclose(file);
-    printf("Generated object file: %s\n", obj_filename);
+    /* --- Part 3: Format every range at its offset --- */
+    runParallelTasks(ctx->options->threads, num_ranges, format_object_range, ranges);
+    free(ranges);
+
+    if (write_output_file(ctx, obj_filename, "object", buffer,
+                          (size_t)(body - buffer) + (size_t)(inst_words + data_words) * OB_LINE_LENGTH)) {
+        fprintf(ctx->out, "Generated object file: %s\n", obj_filename);
+    }
+    free(buffer);
 }
 
 /**
@@ -186,64 +369,128 @@ void writeObjectFile(const char *filename, int ICF, int DCF, DataItem *dataList,
  * 
  * Only generated if at least one valid entry exists
  * 
+ * Only the symbol table's entry index is visited, from its end, so the
+ * lines follow the symbol table's order (newest declaration first).
+ * 
+ * @param ctx Assembly context (error flag and message streams)
  * @param filename Base filename (without extension)
  * @param symTab Symbol table containing all symbols
  */
-void writeEntriesFile(const char *filename, Symbol *symTab) {
+void writeEntriesFile(AssemblerContext *ctx, const char *filename, SymbolTable *symTab) {
     /* All variables declared at top for C90 compliance */
-    FILE *file = NULL;
     char ent_filename[MAX_FILENAME_LENGTH];
-    Symbol *symbol = symTab;
-    int entry_found = 0;
-    char *base4_address;
+    Symbol *symbol;
+    size_t size = 0;
+    char *buffer;
+    char *p;
+    int i;
 
-    /* First pass: check if any entry symbols exist */
+    /* First pass: measure the file; it is empty if there are no entry symbols */
     /* Entry must have valid address (>= MEMORY_START) */
-    while (symbol) {
-        if (symbol->type == SYMBOL_ENTRY && symbol->address >= MEMORY_START) {
-            entry_found = 1;
-            break;
+    for (i = symTab->num_entries - 1; i >= 0; i--) {
+        symbol = symTab->entries[i];
+        if (symbol->address >= MEMORY_START) {
+            size += strlen(symbol->name) + SYMBOL_LINE_EXTRA_LENGTH;
         }
-        symbol = symbol->next;
     }
 
     /* Don't create file if no entries */
-    if (!entry_found) {
-        printf("No valid entry symbols found. '%s.ent' will not be generated.\n", filename);
+    if (size == 0) {
+        fprintf(ctx->out, "No valid entry symbols found. '%s.ent' will not be generated.\n", filename);
         return;
     }
 
-    /* Create entries file */
+    /* Create entries file name */
     sprintf(ent_filename, "%s.ent", filename);
-    file = fopen(ent_filename, "w");
-    if (!file) {
-        fprintf(stderr, "Error: Cannot create entries file '%s'.\n", ent_filename);
-        g_has_error = 1;
-        return;
-    }
 
-    /* Second pass: write all entry symbols */
-    symbol = symTab;
-    while (symbol) {
-        if (symbol->type == SYMBOL_ENTRY && symbol->address >= MEMORY_START) {
-            /* Convert address to base-4 */
-            base4_address = convertToBase4(symbol->address);
-            if (!base4_address) {
-                fprintf(stderr, "Error: Memory allocation failed for entry address.\n");
-                g_has_error = 1; 
-                fclose(file); 
-                return;
-            }
-            
+    /* Second pass: format all entry symbols */
+    buffer = alloc_output_buffer(size);
+    p = buffer;
+    for (i = symTab->num_entries - 1; i >= 0; i--) {
+        symbol = symTab->entries[i];
+        if (symbol->address >= MEMORY_START) {
             /* Write entry: name and address */
-            fprintf(file, "%s %s\n", symbol->name, base4_address);
-            free(base4_address);
+            p = put_symbol_line(p, symbol->name, symbol->address);
         }
-        symbol = symbol->next;
     }
 
-    fclose(file);
-    printf("Generated entries file: %s\n", ent_filename);
+    if (write_output_file(ctx, ent_filename, "entries", buffer, (size_t)(p - buffer))) {
+        fprintf(ctx->out, "Generated entries file: %s\n", ent_filename);
+    }
+    free(buffer);
+}
+
+/**
+ * Sort key of an external reference for the requested .ext order
+ * @param ref The reference
+ * @param order Order of the .ext file
+ * @param num_symbols Number of symbols in the table (symbol ids are below it)
+ * @return The address, or the symbol's position in the symbol table's list
+ */
+static unsigned int reference_key(const ExternalReference *ref, ExternalsOrder order, int num_symbols) {
+    if (order == EXT_ORDER_ADDRESS) {
+        return (unsigned int)ref->address;
+    }
+    /* The list starts with the most recently declared symbol */
+    return (unsigned int)(num_symbols - 1 - ref->sym->id);
+}
+
+/**
+ * Sorts external references by key with a stable LSD radix sort.
+ * References that are already in order (such as the addresses of a
+ * two-pass assembly) are left untouched.
+ * @param refs References to sort in place
+ * @param count Number of references
+ * @param order Order of the .ext file
+ * @param num_symbols Number of symbols in the table
+ */
+static void sort_external_references(ExternalReference *refs, int count, ExternalsOrder order, int num_symbols) {
+    ExternalReference *tmp, *src, *dst, *swap;
+    long buckets[RADIX_SIZE];
+    long total, n;
+    unsigned int key, prev_key = 0, max_key = 0;
+    int sorted = 1;
+    int shift, i;
+
+    for (i = 0; i < count; i++) {
+        key = reference_key(&refs[i], order, num_symbols);
+        if (key < prev_key) sorted = 0;
+        if (key > max_key) max_key = key;
+        prev_key = key;
+    }
+    if (sorted) return;
+
+    tmp = (ExternalReference *)malloc((size_t)count * sizeof(ExternalReference));
+    if (!tmp) {
+        fprintf(stderr, "Memory allocation error for external references.\n");
+        exit(1); /* Critical error, terminate program */
+    }
+
+    /* One counting pass per digit, least significant first; only digits below max_key are needed */
+    src = refs;
+    dst = tmp;
+    for (shift = 0; shift < (int)(sizeof(unsigned int) * CHAR_BIT) && (max_key >> shift) != 0; shift += RADIX_BITS) {
+        memset(buckets, 0, sizeof(buckets));
+        for (i = 0; i < count; i++) {
+            buckets[(reference_key(&src[i], order, num_symbols) >> shift) & (RADIX_SIZE - 1)]++;
+        }
+        total = 0;
+        for (i = 0; i < RADIX_SIZE; i++) {
+            n = buckets[i];
+            buckets[i] = total;
+            total += n;
+        }
+        for (i = 0; i < count; i++) {
+            dst[buckets[(reference_key(&src[i], order, num_symbols) >> shift) & (RADIX_SIZE - 1)]++] = src[i];
+        }
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != refs) {
+        memcpy(refs, src, (size_t)count * sizeof(ExternalReference));
+    }
+    free(tmp);
 }
 
 /**
@@ -253,70 +500,62 @@ void writeEntriesFile(const char *filename, Symbol *symTab) {
  * 
  * Only generated if at least one external is actually used
  * 
+ * The lines come from the symbol table's flat array of external references.
+ * By default they are grouped by symbol in symbol table order (newest
+ * declaration first), each symbol's usages newest first; with
+ * --ext-order=address they are in ascending address order.
+ * 
+ * @param ctx Assembly context (error flag, message streams and .ext order)
  * @param filename Base filename (without extension)
- * @param symTab Symbol table containing all symbols and their usage lists
+ * @param symTab Symbol table holding the external references
  */
-void writeExternalsFile(const char *filename, Symbol *symTab) {
+void writeExternalsFile(AssemblerContext *ctx, const char *filename, SymbolTable *symTab) {
     /* All variables declared at top for C90 compliance */
-    FILE *file = NULL;
     char ext_filename[MAX_FILENAME_LENGTH];
-    Symbol *symbol = symTab;
-    int external_usage_found = 0;
-    ExternalUsage *current;
-    char *base4_address;
-
-    /* First pass: check if any external symbols are actually used */
-    /* Declaration alone isn't enough - must be referenced */
-    while (symbol) {
-        if (symbol->type == SYMBOL_EXTERNAL && symbol->external_usages != NULL) {
-            external_usage_found = 1;
-            break;
-        }
-        symbol = symbol->next;
-    }
+    ExternalReference *refs;
+    int count = symTab->num_externals;
+    size_t size = 0;
+    char *buffer;
+    char *p;
+    int i;
 
     /* Don't create file if no externals are used */
-    if (!external_usage_found) {
-        printf("No external symbol usages found. '%s.ext' will not be generated.\n", filename);
+    /* Declaration alone isn't enough - must be referenced */
+    if (count == 0) {
+        fprintf(ctx->out, "No external symbol usages found. '%s.ext' will not be generated.\n", filename);
         return;
     }
 
-    /* Create externals file */
+    /* Create externals file name */
     sprintf(ext_filename, "%s.ext", filename);
-    file = fopen(ext_filename, "w");
-    if (!file) {
-        fprintf(stderr, "Error: Cannot create externals file '%s'.\n", ext_filename);
-        g_has_error = 1;
-        return;
+
+    /* References are recorded oldest first; the symbol order lists the newest first */
+    refs = (ExternalReference *)malloc((size_t)count * sizeof(ExternalReference));
+    if (!refs) {
+        fprintf(stderr, "Memory allocation error for external references.\n");
+        exit(1); /* Critical error, terminate program */
+    }
+    for (i = 0; i < count; i++) {
+        refs[i] = symTab->externals[ctx->options->ext_order == EXT_ORDER_SYMBOL ? count - 1 - i : i];
     }
+    sort_external_references(refs, count, ctx->options->ext_order, symTab->count);
 
-    /* Second pass: write all external symbol usages */
-    symbol = symTab;
-    while (symbol) {
-        if (symbol->type == SYMBOL_EXTERNAL) {
-            /* Walk through all usage locations for this external */
-            current = symbol->external_usages;
-            while (current) {
-                /* Convert usage address to base-4 */
-                base4_address = convertToBase4(current->address);
-                if (!base4_address) {
-                    fprintf(stderr, "Error: Memory allocation failed for external usage address.\n");
-                    g_has_error = 1; 
-                    fclose(file); 
-                    return;
-                }
-                
-                /* Write one line per usage location */
-                fprintf(file, "%s %s\n", symbol->name, base4_address);
-                free(base4_address);
-                
-                /* Move to next usage */
-                current = current->next;
-            }
-        }
-        symbol = symbol->next;
+    /* Measure the file, one line per usage location */
+    for (i = 0; i < count; i++) {
+        size += strlen(refs[i].sym->name) + SYMBOL_LINE_EXTRA_LENGTH;
     }
+
+    /* Format all external symbol usages */
+    buffer = alloc_output_buffer(size);
+    p = buffer;
+    for (i = 0; i < count; i++) {
+        /* Write one line per usage location */
+        p = put_symbol_line(p, refs[i].sym->name, refs[i].address);
+    }
+    free(refs);
     
-    fclose(file);
-    printf("Generated externals file: %s\n", ext_filename);
-}
\ No newline at end of file
+    if (write_output_file(ctx, ext_filename, "externals", buffer, (size_t)(p - buffer))) {
+        fprintf(ctx->out, "Generated externals file: %s\n", ext_filename);
+    }
+    free(buffer);
+}
@@ -4,85 +4,207 @@
  *
  * This module handles adding, finding, and freeing symbols,
  * including complex logic for duplicate symbol checks, reserved word validation,
- * and management of external symbol usages.
+ * and the table of external symbol references.
+ * Lookups go through an open-addressing hash index over interned names;
+ * the declaration-order linked list is kept for iteration.
+ * Symbols and their names are allocated from the file's arena, so only the
+ * hash index, the entry index and the external references are owned (and freed)
+ * by the table itself.
  */
 
 #include "symbol_table.h"
+#include "arena.h"
 #include <stdio.h>  /* For fprintf, stderr */
 #include <stdlib.h> /* For malloc, free, exit */
-#include <string.h> /* For strcmp, strncpy */
+#include <string.h> /* For strcmp */
 
 /* --- External Dependencies (from other modules) --- */
 /* These are declared in assembler.h and implemented elsewhere (e.g., first_pass.c) */
-extern int g_has_error;
 extern int is_opcode(const char* s);
 extern int is_register(const char* s);
 extern int is_valid_label(const char* s);
 
 
+/* --- Hash Index Helpers --- */
+
+/**
+ * @brief Computes the FNV-1a hash of a symbol name.
+ * @param name The null-terminated name to hash.
+ * @return The hash value (never depends on table capacity).
+ */
+unsigned long hashSymbolName(const char *name) {
+    unsigned long hash = 2166136261UL;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Finds the slot holding 'name', or the empty slot where it would be inserted.
+ * @param table Pointer to the symbol table (capacity must be non-zero).
+ * @param name The name to look for.
+ * @param hash The precomputed hash of 'name'.
+ * @return Index of the matching or first empty slot.
+ */
+static int probe_slot(const SymbolTable *table, const char *name, unsigned long hash) {
+    int mask = table->capacity - 1;
+    int i = (int)(hash & (unsigned long)mask);
+    Symbol *candidate;
+
+    while ((candidate = table->slots[i]) != NULL) {
+        if (candidate->hash == hash && strcmp(candidate->name, name) == 0) {
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/**
+ * @brief Doubles the hash index and reinserts every symbol using its cached hash.
+ * @param table Pointer to the symbol table.
+ */
+static void grow_index(SymbolTable *table) {
+    Symbol **old_slots = table->slots;
+    int old_capacity = table->capacity;
+    int i;
+
+    table->capacity = old_capacity ? old_capacity * 2 : INITIAL_SYMBOL_TABLE_CAPACITY;
+    table->slots = (Symbol **)calloc((size_t)table->capacity, sizeof(Symbol *));
+    if (!table->slots) {
+        fprintf(stderr, "Memory allocation error for symbol table index.\n");
+        exit(1); /* Critical error, terminate program */
+    }
+
+    for (i = 0; i < old_capacity; i++) {
+        if (old_slots[i]) {
+            table->slots[probe_slot(table, old_slots[i]->name, old_slots[i]->hash)] = old_slots[i];
+        }
+    }
+    free(old_slots);
+}
+
+/**
+ * @brief Initializes an empty symbol table. Must be called before any other operation.
+ * @param table Pointer to the SymbolTable to initialize.
+ */
+void initSymbolTable(SymbolTable *table) {
+    table->head = NULL;
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+    table->entries = NULL;
+    table->num_entries = 0;
+    table->entries_capacity = 0;
+    table->externals = NULL;
+    table->num_externals = 0;
+    table->externals_capacity = 0;
+}
+
 /**
  * @brief Searches for a symbol by name in the symbol table.
- * @param head Pointer to the head of the Symbol linked list.
+ * @param table Pointer to the symbol table.
  * @param name The name of the symbol to find.
  * @return A pointer to the Symbol structure if found, otherwise NULL.
  */
-Symbol* findSymbol(Symbol* head, const char* name) {
-    Symbol *current = head;
-    while (current) {
-        if (strcmp(current->name, name) == 0) {
-            return current;
+Symbol* findSymbol(SymbolTable *table, const char* name) {
+    if (!table || table->count == 0) {
+        return NULL;
+    }
+    return table->slots[probe_slot(table, name, hashSymbolName(name))];
+}
+
+/**
+ * @brief Adds a symbol that has just become SYMBOL_ENTRY to the entry index,
+ * keeping the index in ascending id order.
+ * @param table Pointer to the symbol table.
+ * @param sym The entry symbol (not yet in the index).
+ */
+static void index_entry(SymbolTable *table, Symbol *sym) {
+    Symbol **grown;
+    int new_capacity;
+    int i;
+
+    if (table->num_entries == table->entries_capacity) {
+        new_capacity = table->entries_capacity ? table->entries_capacity * 2 : INITIAL_ENTRY_INDEX_CAPACITY;
+        grown = (Symbol **)realloc(table->entries, (size_t)new_capacity * sizeof(Symbol *));
+        if (!grown) {
+            fprintf(stderr, "Memory allocation error for entry index.\n");
+            exit(1); /* Critical error, terminate program */
         }
-        current = current->next;
+        table->entries = grown;
+        table->entries_capacity = new_capacity;
+    }
+
+    /* New symbols have the highest id; only an older label marked .entry moves others */
+    for (i = table->num_entries; i > 0 && table->entries[i - 1]->id > sym->id; i--) {
+        table->entries[i] = table->entries[i - 1];
+    }
+    table->entries[i] = sym;
+    table->num_entries++;
+}
+
+/**
+ * @brief Marks an existing symbol as an entry point and adds it to the entry index.
+ * @param table Pointer to the symbol table that owns 'sym'.
+ * @param sym The symbol (a symbol that is already SYMBOL_ENTRY is left as is).
+ */
+void markEntrySymbol(SymbolTable *table, Symbol *sym) {
+    if (sym->type != SYMBOL_ENTRY) {
+        sym->type = SYMBOL_ENTRY;
+        index_entry(table, sym);
     }
-    return NULL;
 }
 
 /**
  * @brief Adds a new symbol to the symbol table.
  * Handles checks for reserved keywords, invalid label syntax, and duplicate definitions,
  * including specific rules for EXTERNAL and ENTRY symbols.
- * @param head Pointer to the head of the Symbol linked list (will be updated if new symbol is added at head).
+ * @param ctx The assembly context (error flag and diagnostics stream).
+ * @param table Pointer to the symbol table.
  * @param name The name of the symbol.
  * @param address The memory address associated with the symbol.
  * @param type The type of the symbol (CODE, DATA, EXTERNAL, ENTRY).
  * @param line_num The line number in the source file where the symbol is defined/declared (for error reporting).
  */
-void addSymbol(Symbol **head, const char *name, int address, SymbolType type, int line_num) {
+void addSymbol(AssemblerContext *ctx, SymbolTable *table, const char *name, int address, SymbolType type, int line_num) {
 
     Symbol *existingSymbol;
     Symbol *newSymbol;
 
     /* 1. Check if name is a reserved keyword (opcode or register) */
     if (is_opcode(name) || is_register(name)) {
-        fprintf(stderr, "Error at line %d: Symbol '%s' is a reserved keyword and cannot be used as a label.\n", line_num, name);
-        g_has_error = 1;
+        fprintf(ctx->err, "Error at line %d: Symbol '%s' is a reserved keyword and cannot be used as a label.\n", line_num, name);
+        ctx->has_error = 1;
         return;
     }
 
     /* 2. Check if label syntax is valid (starts with alpha, then alphanumeric) */
     if (!is_valid_label(name)) {
-        fprintf(stderr, "Error at line %d: Invalid label name '%s'. Labels must start with an alphabetic character and contain only alphanumeric characters, max %d chars.\n", line_num, name, MAX_SYMBOL_LENGTH - 1);
-        g_has_error = 1;
+        fprintf(ctx->err, "Error at line %d: Invalid label name '%s'. Labels must start with an alphabetic character and contain only alphanumeric characters, max %d chars.\n", line_num, name, MAX_SYMBOL_LENGTH - 1);
+        ctx->has_error = 1;
         return;
     }
 
     /* 3. Check if symbol already exists in the table */
-    existingSymbol = findSymbol(*head, name);
+    existingSymbol = findSymbol(table, name);
     if (existingSymbol != NULL) {
         /* Handle cases for already existing symbol based on types */
         if (type == SYMBOL_EXTERNAL) {
             /* If new type is EXTERNAL: */
             /* - If existing is CODE/DATA: Error (cannot be internal and external) */
             if (existingSymbol->type == SYMBOL_CODE || existingSymbol->type == SYMBOL_DATA) {
-                fprintf(stderr, "Error at line %d: Symbol '%s' is defined internally and declared as external.\n", line_num, name);
-                g_has_error = 1;
+                fprintf(ctx->err, "Error at line %d: Symbol '%s' is defined internally and declared as external.\n", line_num, name);
+                ctx->has_error = 1;
                 return;
             }
             /* - If existing is SYMBOL_EXTERNAL: Redundant declaration, ignore. */
             /* - If existing is SYMBOL_ENTRY: Error (cannot be entry and external simultaneously) */
             if (existingSymbol->type == SYMBOL_ENTRY) {
-                 fprintf(stderr, "Error at line %d: Symbol '%s' is declared as .entry and .extern (mutually exclusive).\n", line_num, name);
-                 g_has_error = 1;
+                 fprintf(ctx->err, "Error at line %d: Symbol '%s' is declared as .entry and .extern (mutually exclusive).\n", line_num, name);
+                 ctx->has_error = 1;
                  return;
             }
             /* If existing is already EXTERNAL, it's a valid re-declaration, so do nothing. */
@@ -91,24 +213,24 @@ void addSymbol(Symbol **head, const char *name, int address, SymbolType type, in
             /* If new type is ENTRY: */
             /* - If existing is EXTERNAL: Error (cannot be entry and external simultaneously) */
             if (existingSymbol->type == SYMBOL_EXTERNAL) {
-                fprintf(stderr, "Error at line %d: Symbol '%s' is declared as .entry and .extern (mutually exclusive).\n", line_num, name);
-                g_has_error = 1;
+                fprintf(ctx->err, "Error at line %d: Symbol '%s' is declared as .entry and .extern (mutually exclusive).\n", line_num, name);
+                ctx->has_error = 1;
                 return;
             }
             /* - If existing is CODE/DATA or already ENTRY: Mark as entry point. This is fine. */
-            existingSymbol->type = SYMBOL_ENTRY;
+            markEntrySymbol(table, existingSymbol);
             return;
         } else { /* New type is CODE or DATA (internal definition) */
             /* If existing is CODE/DATA: Duplicate definition error */
             if (existingSymbol->type == SYMBOL_CODE || existingSymbol->type == SYMBOL_DATA) {
-                fprintf(stderr, "Error at line %d: Symbol '%s' is already defined internally (CODE/DATA).\n", line_num, name);
-                g_has_error = 1;
+                fprintf(ctx->err, "Error at line %d: Symbol '%s' is already defined internally (CODE/DATA).\n", line_num, name);
+                ctx->has_error = 1;
                 return;
             }
             /* If existing is EXTERNAL: It's now defined internally, which is an error. */
             if (existingSymbol->type == SYMBOL_EXTERNAL) {
-                fprintf(stderr, "Error at line %d: Symbol '%s' was declared external but is now defined locally.\n", line_num, name);
-                g_has_error = 1;
+                fprintf(ctx->err, "Error at line %d: Symbol '%s' was declared external but is now defined locally.\n", line_num, name);
+                ctx->has_error = 1;
                 return;
             }
             /* If existing is ENTRY (but not yet defined as CODE/DATA): Now it is defined. */
@@ -118,8 +240,8 @@ void addSymbol(Symbol **head, const char *name, int address, SymbolType type, in
                     /* Type remains SYMBOL_ENTRY */
                 } else {
                     /* Symbol was already defined, and now defined again. This is a duplicate definition error. */
-                    fprintf(stderr, "Error at line %d: Symbol '%s' is already defined internally and being redefined.\n", line_num, name);
-                    g_has_error = 1;
+                    fprintf(ctx->err, "Error at line %d: Symbol '%s' is already defined internally and being redefined.\n", line_num, name);
+                    ctx->has_error = 1;
                 }
                 return; /* Return after handling the entry symbol update */
             }
@@ -127,69 +249,61 @@ void addSymbol(Symbol **head, const char *name, int address, SymbolType type, in
     }
 
     /* If we reach here, the symbol does not exist and we can create it */
-    newSymbol = (Symbol *)malloc(sizeof(Symbol));
-    if (!newSymbol) {
-        fprintf(stderr, "Memory allocation error for symbol '%s'.\n", name);
-        exit(1); /* Critical error, terminate program */
+    /* Keep the index at most half full so probe sequences stay short */
+    if ((table->count + 1) * 2 > table->capacity) {
+        grow_index(table);
     }
-    strncpy(newSymbol->name, name, MAX_SYMBOL_LENGTH - 1);
-    newSymbol->name[MAX_SYMBOL_LENGTH - 1] = '\0'; /* Ensure null-termination */
+
+    newSymbol = (Symbol *)arenaAlloc(&ctx->arena, sizeof(Symbol));
+    /* Every name is stored exactly once, since only new symbols copy it */
+    newSymbol->name = arenaStrdup(&ctx->arena, name);
+    newSymbol->hash = hashSymbolName(name);
     newSymbol->address = address;
     newSymbol->type = type;
-    newSymbol->next = *head;
-    newSymbol->external_usages = NULL; /* Initialize external usages list to NULL */
-    *head = newSymbol;
+    newSymbol->next = table->head;
+    newSymbol->id = table->count;
+    table->head = newSymbol;
+
+    table->slots[probe_slot(table, newSymbol->name, newSymbol->hash)] = newSymbol;
+    table->count++;
+
+    if (type == SYMBOL_ENTRY) {
+        index_entry(table, newSymbol);
+    }
 }
 
 /**
  * @brief Helper function to find a symbol (renamed from 'findSymbol' for clarity within module).
- * @param head Pointer to the head of the Symbol linked list.
+ * @param table Pointer to the symbol table.
  * @param name The name of the symbol to find.
  * @return A pointer to the Symbol structure if found, otherwise NULL.
  */
-Symbol* getSymbol(Symbol *head, const char *name) {
-    return findSymbol(head, name);
+Symbol* getSymbol(SymbolTable *table, const char *name) {
+    return findSymbol(table, name);
 }
 
 
 /**
- * @brief Frees the entire symbol table, including all Symbol structures
- * and any associated external usage lists.
- * @param head Pointer to the head of the Symbol linked list.
+ * @brief Frees the hash index, entry index and external references of the symbol table and empties it.
+ * The Symbol structures and their names belong to the file's arena and are
+ * released together with it.
+ * @param table Pointer to the symbol table.
  */
-void freeSymbolTable(Symbol *head) {
-    
-    Symbol *current = head;
-    Symbol *next_sym;
-    ExternalUsage *current_usage;
-    ExternalUsage *next_usage;
-
-    while (current) {
-        next_sym = current->next;
-        
-        /* Free external usages list if it exists */
-        if (current->external_usages) {
-            current_usage = current->external_usages;
-            while(current_usage) {
-                next_usage = current_usage->next;
-                free(current_usage);
-                current_usage = next_usage;
-            }
-        }
-
-        free(current); /* Free the Symbol struct itself */
-        current = next_sym;
-    }
+void freeSymbolTable(SymbolTable *table) {
+    free(table->slots);
+    free(table->entries);
+    free(table->externals);
+    initSymbolTable(table);
 }
 
 /**
  * @brief Updates the addresses of SYMBOL_DATA entries by adding the final
  * Instruction Counter (ICF) value. This is done at the end of the first pass.
- * @param head Pointer to the head of the Symbol linked list.
+ * @param table Pointer to the symbol table.
  * @param icf The final Instruction Counter value from the first pass.
  */
-void updateDataSymbolsAddresses(Symbol *head, int icf) {
-    Symbol *current = head;
+void updateDataSymbolsAddresses(SymbolTable *table, int icf) {
+    Symbol *current = table->head;
     while (current) {
         if (current->type == SYMBOL_DATA) {
              current->address += icf;
@@ -204,37 +318,46 @@ void updateDataSymbolsAddresses(Symbol *head, int icf) {
 /**
  * @brief Adds a usage address for an external symbol.
  * Called during the second pass when an external symbol is referenced.
+ * @param ctx The assembly context (error flag and diagnostics stream).
+ * @param table Pointer to the symbol table that owns 'sym'.
  * @param sym A pointer to the Symbol structure (must be of type SYMBOL_EXTERNAL).
  * @param address The memory address (IC value) where the external symbol is referenced.
  */
-void addExternalUsage(Symbol *sym, int address) {
+void addExternalUsage(AssemblerContext *ctx, SymbolTable *table, Symbol *sym, int address) {
     
-    ExternalUsage *newUsage;
+    ExternalReference *grown;
+    int new_capacity;
 
     /* Ensure the symbol is indeed of type EXTERNAL. */
     if (!sym || sym->type != SYMBOL_EXTERNAL) {
-        fprintf(stderr, "Internal Error: Attempted to add external usage to a non-external or NULL symbol.\n");
-        g_has_error = 1; /* Mark a global error */
+        fprintf(ctx->err, "Internal Error: Attempted to add external usage to a non-external or NULL symbol.\n");
+        ctx->has_error = 1; /* Mark the file as failed */
         return;
     }
 
-    newUsage = (ExternalUsage *)malloc(sizeof(ExternalUsage));
-    if (!newUsage) {
-        fprintf(stderr, "Memory allocation error for external usage.\n");
-        exit(1); /* Critical memory error, terminate program */
+    if (table->num_externals == table->externals_capacity) {
+        new_capacity = table->externals_capacity ? table->externals_capacity * 2 : INITIAL_EXTERNAL_TABLE_CAPACITY;
+        grown = (ExternalReference *)realloc(table->externals, (size_t)new_capacity * sizeof(ExternalReference));
+        if (!grown) {
+            fprintf(stderr, "Memory allocation error for external references.\n");
+            exit(1); /* Critical error, terminate program */
+        }
+        table->externals = grown;
+        table->externals_capacity = new_capacity;
     }
-    newUsage->address = address;
-    newUsage->next = sym->external_usages; /* Add to head of usages list */
-    sym->external_usages = newUsage;
+    table->externals[table->num_externals].sym = sym;
+    table->externals[table->num_externals].address = address;
+    table->num_externals++;
 }
 
 /**
  * @brief Prints the contents of the symbol table to stdout for debugging purposes.
- * @param head Pointer to the head of the Symbol linked list.
+ * @param table Pointer to the symbol table.
  */
-void printSymbolTable(Symbol* head) {
+void printSymbolTable(SymbolTable *table) {
     
-    ExternalUsage *usage;
+    Symbol *head = table->head;
+    int i;
 
     printf("====== Symbol Table ======\n");
     while (head) {
@@ -248,12 +371,12 @@ void printSymbolTable(Symbol* head) {
         }
         printf("\n");
 
-        if (head->type == SYMBOL_EXTERNAL && head->external_usages) {
-            usage = head->external_usages;
+        if (head->type == SYMBOL_EXTERNAL) {
             printf("  Usages: ");
-            while(usage) {
-                printf("%d ", usage->address);
-                usage = usage->next;
+            for (i = table->num_externals - 1; i >= 0; i--) {
+                if (table->externals[i].sym == head) {
+                    printf("%d ", table->externals[i].address);
+                }
             }
             printf("\n");
         }
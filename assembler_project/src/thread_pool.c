@@ -0,0 +1,100 @@
+/* thread_pool.c */
+/**
+ * @file thread_pool.c
+ * @brief Implements the worker pool used to assemble several files concurrently (-j)
+ * and to split the macro expansion, both passes and the .ob formatting of a single
+ * file across threads (-t).
+ *
+ * Workers share a counter protected by a mutex and repeatedly claim the next task
+ * index. There is no persistent pool: threads are created and joined per call.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+/**
+ * @brief Work shared by all threads of one runParallelTasks call.
+ */
+typedef struct TaskQueue {
+    pthread_mutex_t lock;   /* Protects 'next' */
+    int next;               /* Next task index to hand out */
+    int count;              /* Total number of tasks */
+    ParallelTask task;      /* Function to run */
+    void *arg;              /* Its shared argument */
+} TaskQueue;
+
+/**
+ * @brief Thread body: claims and runs tasks until none are left.
+ * @param queue_ptr Pointer to the TaskQueue.
+ * @return Always NULL.
+ */
+static void* worker_main(void *queue_ptr) {
+    TaskQueue *queue = (TaskQueue *)queue_ptr;
+    int index;
+
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        index = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+
+        if (index >= queue->count) {
+            break;
+        }
+        queue->task(queue->arg, index);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs task(arg, i) for every i in [0, count) on up to num_threads threads.
+ * @param num_threads Maximum number of threads working at once (including the caller).
+ * @param count Number of tasks.
+ * @param task The function to run for each index.
+ * @param arg Argument passed unchanged to every call of 'task'.
+ */
+void runParallelTasks(int num_threads, int count, ParallelTask task, void *arg) {
+    TaskQueue queue;
+    pthread_t *threads;
+    int started;
+    int i;
+
+    if (num_threads > count) {
+        num_threads = count;
+    }
+
+    /* Sequential path: no threads needed */
+    threads = NULL;
+    if (num_threads > 1) {
+        threads = (pthread_t *)malloc((size_t)(num_threads - 1) * sizeof(pthread_t));
+    }
+    if (!threads) {
+        for (i = 0; i < count; i++) {
+            task(arg, i);
+        }
+        return;
+    }
+
+    pthread_mutex_init(&queue.lock, NULL);
+    queue.next = 0;
+    queue.count = count;
+    queue.task = task;
+    queue.arg = arg;
+
+    /* If a thread cannot be created, the ones already running (and the caller) finish the work */
+    for (started = 0; started < num_threads - 1; started++) {
+        if (pthread_create(&threads[started], NULL, worker_main, &queue) != 0) {
+            break;
+        }
+    }
+
+    worker_main(&queue);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&queue.lock);
+    free(threads);
+}
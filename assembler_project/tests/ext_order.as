@@ -0,0 +1,11 @@
+; External references out of declaration order, for both .ext orders
+.extern FIRST
+.extern SECOND
+.extern THIRD
+MAIN: mov THIRD, r1
+ jsr FIRST
+ cmp SECOND, THIRD
+ lea FIRST, r2
+ prn #-4
+ jmp SECOND
+ stop
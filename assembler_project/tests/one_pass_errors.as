@@ -0,0 +1,8 @@
+; One-pass mode (-1) must report every encoding error, as the second pass does
+MAIN: mov #1000, r1
+ jmp UNDEF
+ mov #-900, r2
+ prn #600
+ cmp LOOP, #700
+ jmp UNDEF2
+LOOP: stop